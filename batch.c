@@ -0,0 +1,340 @@
+/* batch.c
+ *
+ * The batch runner and its thread pool, see batch.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+
+typedef struct
+{
+  const char *trace;
+  int traceNo;
+  int configNo;
+  off_t size;
+  cacheStats stats;
+  int failed;
+} batchJob;
+
+// one worker's jobs, largest first; the owner takes from the head, and a
+// thief looks at the head of every other queue and takes the largest
+typedef struct
+{
+  pthread_mutex_t lock;
+  int *jobs;
+  int head;
+  int tail;
+} jobQueue;
+
+typedef struct
+{
+  batchJob *jobs;
+  const cacheConfig *cfgs;
+  jobQueue *queues;
+  int threads;
+} batchPool;
+
+typedef struct
+{
+  batchPool *pool;
+  int self;
+  pthread_t thread;
+} batchWorker;
+
+// read the traces named by list: every file in it if it is a directory,
+// otherwise one file name per line
+static char **readList(const char *list, int *count)
+{
+  char **names = NULL;
+  int n = 0, size = 0;
+  char line[4096], path[4096 + 256];
+  struct stat st;
+  FILE *fp;
+
+  if (stat(list, &st) != 0)
+  {
+     fprintf(stderr, "%s: cannot read trace list\n", list);
+     return NULL;
+  }
+  if (S_ISDIR(st.st_mode))
+  {
+     struct dirent **entries;
+     int i, found = scandir(list, &entries, NULL, alphasort);
+     if (found < 0)
+     {
+        fprintf(stderr, "%s: cannot read directory\n", list);
+        return NULL;
+     }
+     names = malloc((found + 1) * sizeof (char *));
+     for (i = 0; i < found; i++)
+     {
+        snprintf(path, sizeof (path), "%s/%s", list, entries[i]->d_name);
+        if (names != NULL && stat(path, &st) == 0 && S_ISREG(st.st_mode))
+           names[n++] = strdup(path);
+        free(entries[i]);
+     }
+     free(entries);
+     *count = n;
+     return names;
+  }
+
+  fp = fopen(list, "r");
+  if (fp == NULL)
+  {
+     fprintf(stderr, "%s: cannot read trace list\n", list);
+     return NULL;
+  }
+  while (fgets(line, sizeof (line), fp) != NULL)
+  {
+     line[strcspn(line, "\r\n")] = '\0';
+     if (line[0] == '\0' || line[0] == '#')
+        continue;
+     if (n == size)
+     {
+        size = size ? 2 * size : 64;
+        names = realloc(names, size * sizeof (char *));
+        if (names == NULL)
+           break;
+     }
+     names[n++] = strdup(line);
+  }
+  fclose(fp);
+  *count = n;
+  return names;
+}
+
+static int bySize(const void *a, const void *b)
+{
+  const batchJob *x = a, *y = b;
+  if (x->size != y->size)
+     return x->size < y->size ? 1 : -1;
+  if (x->traceNo != y->traceNo)
+     return x->traceNo - y->traceNo;
+  return x->configNo - y->configNo;
+}
+
+static int byOrder(const void *a, const void *b)
+{
+  const batchJob *x = a, *y = b;
+  if (x->traceNo != y->traceNo)
+     return x->traceNo - y->traceNo;
+  return x->configNo - y->configNo;
+}
+
+// run one trace through a fresh cache of one configuration
+static void runJob(batchJob *job, const cacheConfig *cfg)
+{
+  char displayName[64];
+  cache c;
+  trace t;
+  const traceRecord *block;
+  size_t count;
+
+  sprintf(displayName, "display-%d-%d.txt", job->traceNo + 1, job->configNo + 1);
+  job->failed = 1;
+  if (cacheCreate(&c, cfg, NULL) != 0)
+     return;
+  // created only if the trace has an 8 or 9 to write there
+  c.displayName = displayName;
+  if (traceOpen(&t, job->trace) != 0)
+  {
+     fprintf(stderr, "%s: cannot read trace\n", job->trace);
+     cacheFree(&c);
+     return;
+  }
+  while ((count = traceNext(&t, &block)) > 0)
+     cacheRun(&c, block, count);
+  job->failed = t.error;
+  job->stats = c.stats;
+  traceClose(&t);
+  cacheFree(&c);
+}
+
+static int takeJob(jobQueue *q)
+{
+  int job = -1;
+  pthread_mutex_lock(&q->lock);
+  if (q->head < q->tail)
+     job = q->jobs[q->head++];
+  pthread_mutex_unlock(&q->lock);
+  return job;
+}
+
+// the job at the head of a queue without taking it, -1 if there is none
+static int peekJob(jobQueue *q)
+{
+  int job = -1;
+  pthread_mutex_lock(&q->lock);
+  if (q->head < q->tail)
+     job = q->jobs[q->head];
+  pthread_mutex_unlock(&q->lock);
+  return job;
+}
+
+// the largest job at the head of another worker's queue, -1 when they are
+// all empty; jobs are numbered largest first, so that is the lowest number
+static int stealJob(batchPool *pool, int self)
+{
+  int job, head, from, i;
+
+  for (;;)
+  {
+     job = -1;
+     from = -1;
+     for (i = 1; i < pool->threads; i++)
+     {
+        head = peekJob(&pool->queues[(self + i) % pool->threads]);
+        if (head >= 0 && (job < 0 || head < job))
+        {
+           job = head;
+           from = (self + i) % pool->threads;
+        }
+     }
+     if (from < 0)
+        return -1;
+     // another thief may have got there first, then look again
+     job = takeJob(&pool->queues[from]);
+     if (job >= 0)
+        return job;
+  }
+}
+
+static void *workerMain(void *arg)
+{
+  batchWorker *w = arg;
+  batchPool *pool = w->pool;
+  int job;
+
+  for (;;)
+  {
+     job = takeJob(&pool->queues[w->self]);
+     if (job < 0)
+        job = stealJob(pool, w->self);
+     if (job < 0)
+        break;
+     runJob(&pool->jobs[job], &pool->cfgs[pool->jobs[job].configNo]);
+  }
+  return NULL;
+}
+
+static void freePool(batchPool *pool, batchWorker *workers, char **names, int traces)
+{
+  int k;
+
+  for (k = 0; pool->queues != NULL && k < pool->threads; k++)
+  {
+     pthread_mutex_destroy(&pool->queues[k].lock);
+     free(pool->queues[k].jobs);
+  }
+  for (k = 0; k < traces; k++)
+     free(names[k]);
+  free(names);
+  free(pool->queues);
+  free(pool->jobs);
+  free(workers);
+}
+
+// run every trace named by list against every configuration on the given
+// number of threads and print one row of stats per pair
+// returns 1 if the list cannot be read or any job failed
+int batchRun(const char *list, const cacheConfig *cfgs, int configs, int threads)
+{
+  batchPool pool;
+  batchWorker *workers;
+  batchJob *jobs;
+  char **names;
+  struct stat st;
+  int traces = 0, n, i, k, started, width = 5, failed = 0;
+
+  names = readList(list, &traces);
+  if (names == NULL)
+     return 1;
+  n = traces * configs;
+  if (threads > n)
+     threads = n > 0 ? n : 1;
+
+  jobs = calloc(n > 0 ? n : 1, sizeof (batchJob));
+  pool.jobs = jobs;
+  pool.cfgs = cfgs;
+  pool.threads = threads;
+  pool.queues = calloc(threads, sizeof (jobQueue));
+  workers = calloc(threads, sizeof (batchWorker));
+  for (k = 0; pool.queues != NULL && k < threads; k++)
+  {
+     pthread_mutex_init(&pool.queues[k].lock, NULL);
+     pool.queues[k].jobs = malloc((n / threads + 1) * sizeof (int));
+     if (pool.queues[k].jobs == NULL)
+        failed = 1;
+  }
+  if (jobs == NULL || pool.queues == NULL || workers == NULL || failed)
+  {
+     fprintf(stderr, "cannot allocate %d jobs\n", n);
+     freePool(&pool, workers, names, traces);
+     return 1;
+  }
+  for (i = 0; i < n; i++)
+  {
+     jobs[i].trace = names[i / configs];
+     jobs[i].traceNo = i / configs;
+     jobs[i].configNo = i % configs;
+     jobs[i].size = stat(jobs[i].trace, &st) == 0 ? st.st_size : 0;
+  }
+
+  // deal the jobs out largest first, round robin
+  qsort(jobs, n, sizeof (batchJob), bySize);
+  for (i = 0; i < n; i++)
+  {
+     jobQueue *q = &pool.queues[i % threads];
+     q->jobs[q->tail++] = i;
+  }
+
+  for (started = 0; started < threads; started++)
+  {
+     workers[started].pool = &pool;
+     workers[started].self = started;
+     if (pthread_create(&workers[started].thread, NULL, workerMain, &workers[started]) != 0)
+        break;
+  }
+  // the threads that did start steal the others' jobs, so every job is
+  // still run
+  if (started < threads)
+     fprintf(stderr, "cannot start %d threads, running on %d\n", threads, started);
+  for (k = 0; k < started; k++)
+     pthread_join(workers[k].thread, NULL);
+  if (started == 0)
+  {
+     freePool(&pool, workers, names, traces);
+     return 1;
+  }
+
+  // the table, in the order the traces and configurations were given
+  qsort(jobs, n, sizeof (batchJob), byOrder);
+  for (i = 0; i < traces; i++)
+  {
+     if ((int) strlen(names[i]) > width)
+        width = strlen(names[i]);
+  }
+  printf("%-*s ", width, "trace");
+  cachePrintHeader();
+  for (i = 0; i < n; i++)
+  {
+     printf("%-*s ", width, jobs[i].trace);
+     if (jobs[i].failed)
+     {
+        printf("failed\n");
+        failed = 1;
+     }
+     else
+        cachePrintRow(&cfgs[jobs[i].configNo], &jobs[i].stats);
+  }
+
+  freePool(&pool, workers, names, traces);
+  return failed;
+}
@@ -0,0 +1,21 @@
+/* batch.h
+ *
+ * Running many traces through many cache configurations in one process.
+ *
+ * Every trace is run against every configuration as a job with its own
+ * cache. The jobs are ordered largest trace first and dealt out to a pool
+ * of threads, each with its own queue; a thread whose queue runs dry
+ * steals the largest job left in the others'. When all jobs are done one
+ * table of stats is printed, in the order the traces and configurations
+ * were given.
+ *
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "cache.h"
+
+int batchRun(const char *list, const cacheConfig *cfgs, int configs, int threads);
+
+#endif
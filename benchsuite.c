@@ -0,0 +1,309 @@
+/* benchsuite.c
+ *
+ * Runs ./main over the synthetic traces of tracegen in a number of
+ * configurations and compares its speed and memory with a baseline kept
+ * in benchmarks/baseline.txt, so a change that slows the simulator down
+ * shows up before it is committed.
+ *
+ * usage: benchsuite [-n references] [-r runs] [-t percent] [-b baseline] [-w]
+ *
+ * The traces are written to benchmarks/ by ./tracegen the first time they
+ * are needed, with the number of references in their names. Each case is
+ * run -r times (5) and the run taking the least processor time, user and
+ * system, counts, since elapsed time depends too much on whatever else
+ * the machine is doing. Its memory is the maximum resident set less the
+ * size of the trace, which main maps and reads whole, so that what is
+ * measured is the simulator's own. A case more than -t percent (20)
+ * slower or bigger than the baseline is a regression, and the exit
+ * status is 1 if there was any. -w writes the results as the new
+ * baseline instead. The baseline only means something on the machine it
+ * was measured on.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "trace.h"
+
+#define BENCH_DIR "benchmarks"
+#define MAX_ARGS 16
+
+typedef struct
+{
+  const char *name;
+  const char *kind;    // the trace, see tracegen.c
+  const char *args;    // options for ./main before the trace
+} benchCase;
+
+static const benchCase cases[] =
+{
+  { "seq", "seq", "" },
+  { "stride-srrip", "stride", "-s 4K -w 8 -r srrip" },
+  { "random", "random", "" },
+  { "random-drrip", "random", "-r drrip" },
+  { "zipf-4way", "zipf", "-s 4K -w 4" },
+  { "zipf-classify", "zipf", "-s 4K -w 4 -C" },
+  { "stride-prefetch", "stride", "-s 4K -w 8 -F stride=16" },
+  { "zipf-hierarchy", "zipf", "-s 4K -H l3=16Kx16" },
+  { "share", "share", "" },
+  { "share-4core", "share", "-P 4 -s 1K" },
+  { "share-directory", "share", "-P 4 -s 1K -D ways=8" },
+};
+
+#define CASES (int) (sizeof (cases) / sizeof (cases[0]))
+
+typedef struct
+{
+  char name[32];
+  unsigned long long refs;
+  double rate;         // M references/s
+  double mb;           // maximum resident set, less the trace
+} benchResult;
+
+// run argv in the benchmark directory with its output thrown away;
+// returns its exit status, or -1, and its processor time and maximum
+// resident set
+static int run(char *const argv[], double *seconds, double *mb)
+{
+  struct rusage ru;
+  int status, fd;
+  pid_t pid;
+
+  pid = fork();
+  if (pid < 0)
+     return -1;
+  if (pid == 0)
+  {
+     fd = open("/dev/null", O_WRONLY);
+     if (fd < 0 || chdir(BENCH_DIR) != 0)
+        _exit(127);
+     dup2(fd, 1);
+     dup2(fd, 2);
+     execv(argv[0], argv);
+     _exit(127);
+  }
+  if (wait4(pid, &status, 0, &ru) != pid)
+     return -1;
+  *seconds = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 +
+             ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+  *mb = ru.ru_maxrss / 1024.0;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// the trace of the given kind, generated if it is not there yet; *traceMb
+// is set to its size
+static int makeTrace(const char *kind, const char *gen, unsigned long long refs,
+                     char *path, size_t size, double *traceMb)
+{
+  struct stat st;
+  char count[32], full[256];
+  char *argv[5];
+  double seconds, mb;
+
+  snprintf(path, size, "%s-%llu.bin", kind, refs);
+  snprintf(full, sizeof (full), BENCH_DIR "/%s", path);
+  if (stat(full, &st) != 0)
+  {
+     fprintf(stderr, "generating %s/%s\n", BENCH_DIR, path);
+     snprintf(count, sizeof (count), "%llu", refs);
+     argv[0] = (char *) gen;
+     argv[1] = (char *) kind;
+     argv[2] = count;
+     argv[3] = path;
+     argv[4] = NULL;
+     if (run(argv, &seconds, &mb) != 0 || stat(full, &st) != 0)
+        return -1;
+  }
+  *traceMb = st.st_size / 1048576.0;
+  return 0;
+}
+
+static int readBaseline(const char *name, benchResult *base, int max)
+{
+  char line[256];
+  int n = 0;
+  FILE *fp;
+
+  fp = fopen(name, "r");
+  if (fp == NULL)
+     return 0;
+  while (n < max && fgets(line, sizeof (line), fp) != NULL)
+  {
+     if (line[0] == '#')
+        continue;
+     if (sscanf(line, "%31s %llu %lf %lf", base[n].name, &base[n].refs,
+                &base[n].rate, &base[n].mb) == 4)
+        n++;
+  }
+  fclose(fp);
+  return n;
+}
+
+static int writeBaseline(const char *name, const benchResult *res, int n)
+{
+  FILE *fp;
+  int i;
+
+  fp = fopen(name, "w");
+  if (fp == NULL)
+     return -1;
+  fprintf(fp, "# case references Mrefs/s MB, written by 'make baseline'\n");
+  for (i = 0; i < n; i++)
+     fprintf(fp, "%s %llu %.2f %.1f\n", res[i].name, res[i].refs, res[i].rate, res[i].mb);
+  return fclose(fp);
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-n references] [-r runs] [-t percent] [-b baseline] [-w]\n",
+          name);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  static benchResult res[CASES], base[CASES];
+  char mainPath[4096], genPath[4096];
+  char trace[64], args[128];
+  char *av[MAX_ARGS + 3];
+  const char *baseName = BENCH_DIR "/baseline.txt";
+  unsigned long long refs = 10ull << 20;
+  uint64_t n;
+  double tolerance = 20;
+  double seconds, mb, best, bestMb, traceMb;
+  int runs = 5, write = 0, bases, compared = 0, regressions = 0;
+  int opt, i, j, k, status;
+  char *tok, *save;
+
+  while ((opt = getopt(argc, argv, "n:r:t:b:w")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n':
+        if (parseSize(optarg, &n) != 0 || n == 0)
+           usage(argv[0]);
+        refs = n;
+        break;
+      case 'r':
+        runs = atoi(optarg);
+        if (runs < 1)
+           usage(argv[0]);
+        break;
+      case 't':
+        tolerance = atof(optarg);
+        break;
+      case 'b':
+        baseName = optarg;
+        break;
+      case 'w':
+        write = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  // the children run in the benchmark directory
+  if (realpath("main", mainPath) == NULL || realpath("tracegen", genPath) == NULL)
+  {
+     fprintf(stderr, "run %s where main and tracegen are built\n", argv[0]);
+     return 1;
+  }
+  mkdir(BENCH_DIR, 0755);
+  bases = write ? 0 : readBaseline(baseName, base, CASES);
+
+  printf("%-18s %12s %9s %9s %8s %9s %8s\n", "case", "references", "cpu s",
+         "Mrefs/s", "MB", "baseline", "change");
+  for (i = 0; i < CASES; i++)
+  {
+     if (makeTrace(cases[i].kind, genPath, refs, trace, sizeof (trace), &traceMb) != 0)
+     {
+        fprintf(stderr, "cannot generate the %s trace\n", cases[i].kind);
+        return 1;
+     }
+     k = 0;
+     av[k++] = mainPath;
+     snprintf(args, sizeof (args), "%s", cases[i].args);
+     for (tok = strtok_r(args, " ", &save); tok != NULL && k <= MAX_ARGS;
+          tok = strtok_r(NULL, " ", &save))
+        av[k++] = tok;
+     av[k++] = trace;
+     av[k] = NULL;
+
+     best = 0;
+     bestMb = 0;
+     for (j = 0; j < runs; j++)
+     {
+        status = run(av, &seconds, &mb);
+        if (status != 0)
+        {
+           fprintf(stderr, "%s: main exited with %d\n", cases[i].name, status);
+           return 1;
+        }
+        if (j == 0 || seconds < best)
+           best = seconds;
+        mb = mb > traceMb ? mb - traceMb : 0;
+        if (j == 0 || mb < bestMb)
+           bestMb = mb;
+     }
+     snprintf(res[i].name, sizeof (res[i].name), "%s", cases[i].name);
+     res[i].refs = refs;
+     res[i].rate = refs / best / 1e6;
+     res[i].mb = bestMb;
+     printf("%-18s %12llu %9.3f %9.2f %8.1f", res[i].name, refs, best, res[i].rate,
+            res[i].mb);
+
+     // compared only with a baseline of as many references
+     for (j = 0; j < bases; j++)
+        if (strcmp(base[j].name, res[i].name) == 0 && base[j].refs == refs)
+           break;
+     if (j == bases)
+        printf(" %9s\n", "-");
+     else
+     {
+        double slower = (base[j].rate / res[i].rate - 1) * 100;
+        double bigger = (res[i].mb / base[j].mb - 1) * 100;
+
+        compared++;
+        printf(" %9.2f %+7.1f%%", base[j].rate, -slower);
+        if (slower > tolerance)
+        {
+           printf("  SLOWER");
+           regressions++;
+        }
+        if (bigger > tolerance)
+        {
+           printf("  BIGGER (%.1f MB)", base[j].mb);
+           regressions++;
+        }
+        printf("\n");
+     }
+     fflush(stdout);
+  }
+
+  if (write)
+  {
+     if (writeBaseline(baseName, res, CASES) != 0)
+     {
+        fprintf(stderr, "%s: cannot write\n", baseName);
+        return 1;
+     }
+     printf("baseline written to %s\n", baseName);
+     return 0;
+  }
+  if (compared == 0)
+     printf("no baseline in %s for %llu references, 'make baseline' writes one\n",
+            baseName, refs);
+  else if (regressions)
+     printf("%d regression%s beyond %.0f%%\n", regressions, regressions > 1 ? "s" : "",
+            tolerance);
+  return regressions ? 1 : 0;
+}
@@ -0,0 +1,805 @@
+/* cache.c
+ *
+ * Creating, resetting and displaying a cache, and running trace
+ * references against it.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "profile.h"
+
+static void chooseKernel(cache *c);
+
+void cacheDefaults(cacheConfig *cfg)
+{
+  cfg->sets = DEFAULT_SETS;
+  cfg->ways = DEFAULT_WAYS;
+  cfg->lineSize = DEFAULT_LINESIZE;
+  cfg->addrBits = DEFAULT_ADDRBITS;
+  cfg->policy = REPL_LRU;
+  cfg->generic = 0;
+}
+
+// read a count such as 16384, 16K or 1M, see parseSize(), that is not 0
+// and fits in 32 bits
+int parseCount(const char *value, unsigned *count)
+{
+  uint64_t n;
+  if (parseSize(value, &n) != 0 || n == 0 || n > 0xffffffffu)
+     return -1;
+  *count = n;
+  return 0;
+}
+
+// set one geometry or policy parameter by name, as given to -f or on the
+// command line; returns -1 if the key or value is not understood
+int cacheConfigOption(cacheConfig *cfg, const char *key, const char *value)
+{
+  if (strcmp(key, "sets") == 0)
+     return parseCount(value, &cfg->sets);
+  if (strcmp(key, "ways") == 0)
+     return parseCount(value, &cfg->ways);
+  if (strcmp(key, "line") == 0)
+     return parseCount(value, &cfg->lineSize);
+  if (strcmp(key, "addrbits") == 0)
+     return parseCount(value, &cfg->addrBits);
+  if (strcmp(key, "kernel") == 0)
+  {
+     if (strcmp(value, "generic") != 0 && strcmp(value, "auto") != 0)
+        return -1;
+     cfg->generic = strcmp(value, "generic") == 0;
+     return 0;
+  }
+  if (strcmp(key, "policy") == 0)
+  {
+     int policy = replLookup(value);
+     if (policy < 0)
+        return -1;
+     cfg->policy = policy;
+     return 0;
+  }
+  return -1;
+}
+
+// apply a comma separated list of key=value settings, e.g. "ways=8,policy=srrip"
+int cacheConfigSpec(cacheConfig *cfg, const char *spec)
+{
+  char buf[256];
+  char *item, *value, *save;
+
+  if (strlen(spec) >= sizeof (buf))
+     return -1;
+  strcpy(buf, spec);
+  for (item = strtok_r(buf, ",", &save); item != NULL;
+       item = strtok_r(NULL, ",", &save))
+  {
+     value = strchr(item, '=');
+     if (value == NULL)
+        return -1;
+     *value++ = '\0';
+     if (cacheConfigOption(cfg, item, value) != 0)
+        return -1;
+  }
+  return 0;
+}
+
+// read 'key = value' lines into cfg, '#' starts a comment
+int cacheConfigFile(cacheConfig *cfg, const char *name)
+{
+  char line[256], key[64], value[64];
+  int lineNo = 0;
+  FILE *fp = fopen(name, "r");
+  if (fp == NULL)
+  {
+     fprintf(stderr, "%s: cannot read config\n", name);
+     return -1;
+  }
+  while (fgets(line, sizeof (line), fp) != NULL)
+  {
+     char *p = strchr(line, '#');
+     lineNo++;
+     if (p != NULL)
+        *p = '\0';
+     for (p = line; *p; p++)
+     {
+        if (*p == '=')
+           *p = ' ';
+     }
+     switch (sscanf(line, "%63s %63s", key, value))
+     {
+       case EOF:
+         continue;
+       case 2:
+         if (cacheConfigOption(cfg, key, value) == 0)
+            continue;
+     }
+     fprintf(stderr, "%s:%d: bad config line\n", name, lineNo);
+     fclose(fp);
+     return -1;
+  }
+  fclose(fp);
+  return 0;
+}
+
+static int log2Exact(uint32_t n)
+{
+  return (n & (n - 1)) == 0 ? __builtin_ctz(n) : -1;
+}
+
+void makeDivider(divider *dv, uint32_t d)
+{
+  dv->d = d;
+  dv->shift = log2Exact(d);
+  // exact for every 32-bit dividend when d is not a power of two (d >= 3)
+  dv->magic = dv->shift >= 0 ? 0 : UINT64_MAX / d + 1;
+}
+
+// check the geometry in c->config and derive how addresses are split
+// returns -1, after saying why, if the geometry cannot be simulated
+
+static int cacheGeometry(cache *c)
+{
+  const cacheConfig *cfg = &c->config;
+
+  if (cfg->ways < 1 || cfg->ways > MAXWAYS)
+  {
+     fprintf(stderr, "ways must be 1 to %d\n", MAXWAYS);
+     return -1;
+  }
+  if (cfg->addrBits < 1 || cfg->addrBits > 32)
+  {
+     fprintf(stderr, "address bits must be 1 to 32\n");
+     return -1;
+  }
+  c->addrMask = cfg->addrBits == 32 ? 0xffffffffu : (1u << cfg->addrBits) - 1;
+  c->wayMask = (1u << cfg->ways) - 1;
+  makeDivider(&c->lineDiv, cfg->lineSize);
+  makeDivider(&c->setDiv, cfg->sets);
+  c->pow2 = c->lineDiv.shift >= 0 && c->setDiv.shift >= 0;
+  if (c->pow2)
+  {
+     c->offsetBits = c->lineDiv.shift;
+     c->indexBits = c->setDiv.shift;
+     c->indexMask = cfg->sets - 1;
+  }
+  if ((uint64_t) cfg->sets * cfg->lineSize > (uint64_t) c->addrMask + 1)
+  {
+     fprintf(stderr, "%u sets of %u bytes do not fit in %u address bits\n",
+             cfg->sets, cfg->lineSize, cfg->addrBits);
+     return -1;
+  }
+  return 0;
+}
+
+// the arena holds the sets, then the addresses, then the occupancy bitmap,
+// each starting on a host cache line; point the cache's arrays into it,
+// unless arena is NULL, and return the arena's size
+
+static size_t arenaLayout(cache *c, char *arena)
+{
+  size_t setBytes = ((size_t) c->config.sets * sizeof (cacheSet) + 63) & ~(size_t) 63;
+  size_t addressBytes = ((size_t) c->config.sets * c->config.ways * sizeof (uint32_t) + 63)
+                        & ~(size_t) 63;
+  size_t occupiedBytes = (((size_t) c->config.sets + 63) / 64 * sizeof (uint64_t) + 63)
+                         & ~(size_t) 63;
+
+  if (arena != NULL)
+  {
+     c->arena = arena;
+     c->set = (cacheSet *) arena;
+     c->address = (uint32_t *) (arena + setBytes);
+     c->occupied = (uint64_t *) (arena + setBytes + addressBytes);
+  }
+  return setBytes + addressBytes + occupiedBytes;
+}
+
+// open the display file and pick the kernel, the last steps of both
+// cacheCreate() and cacheRestore()
+
+static int cacheOpen(cache *c, const char *displayName)
+{
+  // open the output file to make it available to append each iteration's result
+  // without a name it is left to the caller to set c->displayName, which
+  // is then opened by the first 8 or 9
+  c->displayName = displayName;
+  if (displayName != NULL)
+  {
+     c->ofp = fopen(displayName, "w");
+     if (c->ofp == NULL)
+     {
+        fprintf(stderr, "%s: cannot create\n", displayName);
+        return -1;
+     }
+  }
+  chooseKernel(c);
+  return 0;
+}
+
+// where 8 and 9 write, opened now if it was left until needed; NULL, after
+// saying why once, if it cannot be
+static FILE *displayFile(cache *c)
+{
+  if (c->ofp == NULL && c->displayName != NULL)
+  {
+     c->ofp = fopen(c->displayName, "w");
+     if (c->ofp == NULL)
+        fprintf(stderr, "%s: cannot create\n", c->displayName);
+     c->displayName = NULL;
+  }
+  return c->ofp;
+}
+
+// allocate the cache described by cfg and derive how addresses are split
+// returns -1, after saying why, if the geometry cannot be simulated
+
+int cacheCreate(cache *c, const cacheConfig *cfg, const char *displayName)
+{
+  size_t size;
+
+  memset(c, 0, sizeof (cache));
+  c->config = *cfg;
+  if (cacheGeometry(c) != 0)
+     return -1;
+
+  // the sets, addresses and bitmap are one allocation, so that a
+  // checkpoint can write and map them whole
+  size = arenaLayout(c, NULL);
+  c->arena = aligned_alloc(64, size);
+  if (c->arena == NULL)
+  {
+     fprintf(stderr, "cannot allocate %u sets\n", cfg->sets);
+     return -1;
+  }
+  memset(c->arena, 0, size);
+  arenaLayout(c, c->arena);
+
+  if (cacheOpen(c, displayName) != 0)
+  {
+     cacheFree(c);
+     return -1;
+  }
+  cacheReset(c);
+  return 0;
+}
+
+void cacheFree(cache *c)
+{
+  if (c->map != NULL)
+     munmap(c->map, c->mapSize);
+  else
+     free(c->arena);
+  free(c->displayBuf);
+  if (c->ofp != NULL)
+     fclose(c->ofp);
+  memset(c, 0, sizeof (cache));
+}
+
+// write everything needed to carry on from here to a checkpoint file:
+// the header, padded to a page, then the arena as it is in memory
+// refs is how far into the trace the cache has got
+
+int cacheSave(const cache *c, const char *name, uint64_t refs)
+{
+  char page[CHECKPOINT_PAGE];
+  checkpointHeader *h = (checkpointHeader *) page;
+  cache copy = *c;
+  size_t size = arenaLayout(&copy, NULL);
+  char tmp[4096];
+  FILE *fp;
+  int err;
+
+  memset(page, 0, sizeof (page));
+  memcpy(h->magic, CHECKPOINT_MAGIC, 4);
+  h->version = CHECKPOINT_VERSION;
+  h->sets = c->config.sets;
+  h->ways = c->config.ways;
+  h->lineSize = c->config.lineSize;
+  h->addrBits = c->config.addrBits;
+  h->policy = c->config.policy;
+  h->epoch = c->epoch;
+  h->psel = c->psel;
+  h->refs = refs;
+  h->arenaSize = size;
+  h->stats = c->stats;
+
+  // written under another name and renamed over the old checkpoint, which
+  // the arena may be mapped from, so that a save never truncates the pages
+  // it is writing and a failed one leaves the old checkpoint as it was
+  if (snprintf(tmp, sizeof (tmp), "%s.tmp", name) >= (int) sizeof (tmp) ||
+      (fp = fopen(tmp, "wb")) == NULL)
+  {
+     fprintf(stderr, "%s: cannot create\n", name);
+     return -1;
+  }
+  err = fwrite(page, sizeof (page), 1, fp) != 1 || fwrite(c->arena, size, 1, fp) != 1;
+  err |= fclose(fp) != 0;
+  if (err || rename(tmp, name) != 0)
+  {
+     fprintf(stderr, "%s: write failed\n", name);
+     unlink(tmp);
+     return -1;
+  }
+  return 0;
+}
+
+// bring back a cache saved by cacheSave(), mapping the arena straight from
+// the file: pages are read as the simulation touches them and copied on
+// write, so the file itself is never changed
+// *refs is set to how far into its trace the saved cache had got
+// kernel is the only setting taken from cfg
+
+int cacheRestore(cache *c, const char *name, const cacheConfig *cfg,
+                 const char *displayName, uint64_t *refs)
+{
+  const checkpointHeader *h;
+  struct stat st;
+  int fd;
+
+  memset(c, 0, sizeof (cache));
+  fd = open(name, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < CHECKPOINT_PAGE)
+  {
+     fprintf(stderr, "%s: cannot read checkpoint\n", name);
+     if (fd >= 0)
+        close(fd);
+     return -1;
+  }
+  c->mapSize = st.st_size;
+  c->map = mmap(NULL, c->mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (c->map == MAP_FAILED)
+  {
+     c->map = NULL;
+     fprintf(stderr, "%s: cannot map checkpoint\n", name);
+     return -1;
+  }
+
+  h = c->map;
+  c->config.sets = h->sets;
+  c->config.ways = h->ways;
+  c->config.lineSize = h->lineSize;
+  c->config.addrBits = h->addrBits;
+  c->config.policy = h->policy;
+  c->config.generic = cfg->generic;
+  if (memcmp(h->magic, CHECKPOINT_MAGIC, 4) != 0 || h->version != CHECKPOINT_VERSION ||
+      h->policy < 0 || h->policy >= REPL_POLICIES || cacheGeometry(c) != 0 ||
+      arenaLayout(c, NULL) != h->arenaSize ||
+      (uint64_t) c->mapSize != CHECKPOINT_PAGE + h->arenaSize)
+  {
+     fprintf(stderr, "%s: not a checkpoint of this simulator\n", name);
+     cacheFree(c);
+     return -1;
+  }
+  arenaLayout(c, (char *) c->map + CHECKPOINT_PAGE);
+  c->epoch = h->epoch;
+  c->psel = h->psel;
+  c->stats = h->stats;
+  *refs = h->refs;
+
+  if (cacheOpen(c, displayName) != 0)
+  {
+     cacheFree(c);
+     return -1;
+  }
+  return 0;
+}
+
+// reset the cache: every set goes back to its initial values, which
+// resetSet() gives a set on its first touch in the new epoch
+// replacement state starts as the policy's initial state (for LRU, the
+// LRU rank of each way is the way itself)
+// MESI bit begins invalid (empty)
+// Tag bits set to null because access decisions based on MESI
+// only when the epoch wraps are the sets walked, as a set last touched
+// 2^32 resets ago would look current
+
+void cacheReset(cache *c)
+{
+  uint32_t index;
+  memset(c->occupied, 0, (c->config.sets + 63) / 64 * sizeof (uint64_t));
+  c->epoch++;
+  if (c->epoch == 0)
+  {
+    for (index = 0; index < c->config.sets; index++)
+      resetSet(c, index);
+  }
+  c->psel = PSEL_MAX / 2;
+}
+
+// append to the snapshot being built in c->displayBuf, growing it as needed
+static void displayAppend(cache *c, size_t *len, const char *fmt, ...)
+{
+   va_list ap;
+   int n;
+
+   for (;;)
+   {
+      va_start(ap, fmt);
+      n = vsnprintf(c->displayBuf + *len, c->displaySize - *len, fmt, ap);
+      va_end(ap);
+      if (n >= 0 && *len + n < c->displaySize)
+         break;
+      c->displaySize = c->displaySize ? 2 * c->displaySize : 1 << 16;
+      c->displayBuf = realloc(c->displayBuf, c->displaySize);
+      if (c->displayBuf == NULL)
+      {
+         fprintf(stderr, "cannot allocate the display\n");
+         exit(1);
+      }
+   }
+   *len += n;
+}
+
+// The cache displays all indices containing at least one way with a 
+// valid MESI bit
+// only the sets marked in the occupancy bitmap are visited, and the whole
+// snapshot is formatted in memory and written at once
+
+void cacheDisplay(cache *c)
+{
+   uint32_t index, word;
+   unsigned way;
+   uint64_t bits;
+   size_t len = 0;
+
+   for (word = 0; word < (c->config.sets + 63) / 64; word++)
+   {
+      for (bits = c->occupied[word]; bits != 0; bits &= bits - 1)
+      {
+         index = word * 64 + __builtin_ctzll(bits);
+         displayAppend(c, &len, "INDEX: 0x%-8x\n", index);
+
+         for (way = 0; way < c->config.ways; way++)
+         {
+            displayAppend(c, &len, "WAY %-8d LRU: %-4d MESI: %-10d TAG: %-8u"
+                          " ADDR: 0x%-8x\n",
+                          way,
+                          replRank(c->config.policy, c->set[index].repl, way, c->config.ways),
+                          getMESI(c, index, way),
+                          c->set[index].tag[way],
+                          c->address[index * c->config.ways + way]);
+         }
+      }
+   }
+
+   displayAppend(c, &len, "---------------------------------------------------------------------\n");
+   if (displayFile(c) == NULL)
+      return;
+   fwrite(c->displayBuf, 1, len, c->ofp);
+   fflush(c->ofp);
+}
+
+// carry out one 'n address' reference from the trace against the cache
+// policy and kWays are constants in every caller, so each kernel below gets
+// its own copy of this with the replacement policy inlined and, when kWays
+// is not 0, the number of ways and the 64-byte line offset built in
+// timed is a constant too: only its copy for 1 times the phases
+
+static inline __attribute__((always_inline))
+void reference(const int policy, const unsigned kWays, cache *c, int n, uint32_t addr,
+               const int timed)
+{
+    int way;
+    uint32_t index, tag;
+    const unsigned ways = kWays ? kWays : c->config.ways;
+
+    splitAddress(c, addr, &index, &tag, kWays != 0);
+    freshenSet(c, index);
+    c->stats.refCount++;
+
+    switch (n) 
+    {
+      // n = 0 read data request from L1 cache
+      // n = 2 instruction fetch (treated as a read request from L1 cache)
+      case 0:
+      case 2:
+	c->stats.readCount++;
+        PROFILE_TIME(timed, PROF_LOOKUP, way = checkTagWays(c, index, tag, kWays));
+        // if the tag exists
+	if (way < MAXWAYS)
+	{
+	   int MESI = getMESI(c, index, way);
+	   // if this tag exists and it's valid as per its MESI bits
+	   if (MESI == M || MESI == E || MESI == S)
+	   {
+	      c->stats.hitCount++;
+	      PROFILE_TIME(timed, PROF_REPLACE, touchWay(policy, c, index, way, ways));
+              // MESI remains unchanged
+  	   }
+           // if this tag exists but it's been invalidated and can't be used...
+           // we fetch from DRAM and pass on to L1 cache, update to exclusive
+	   else 
+           {
+	      c->stats.missCount++;
+              c->stats.fills++;
+              PROFILE_TIME(timed, PROF_REPLACE, fillWay(policy, c, index, way, ways));
+	      setMESI(c, index, way, E);
+	   }
+	}
+        // this tag simply doesn't exist in the cache in any form
+        else
+  	{
+	   c->stats.missCount++;
+           c->stats.fills++;
+	   // use the replacement state to determine which way to evict
+	   // a modified victim is written back before it is overwritten
+	   PROFILE_TIME(timed, PROF_REPLACE, way = chooseVictim(policy, c, index, ways));
+           if (getMESI(c, index, way) == M)
+              c->stats.writebacks++;
+           PROFILE_TIME(timed, PROF_REPLACE, fillWay(policy, c, index, way, ways));
+           c->set[index].tag[way] = tag;
+	   setMESI(c, index, way, E);
+        }
+        c->address[index * c->config.ways + way] = addr;
+	break;
+      // 1 write data request from L1 cache
+      case 1:
+	c->stats.writeCount++; 
+        PROFILE_TIME(timed, PROF_LOOKUP, way = checkTagWays(c, index, tag, kWays));
+	if (way < MAXWAYS)
+	{
+	   int MESI = getMESI(c, index, way);
+	   // if this tag exists and it's valid per its MESI bits...
+	   if (MESI == M || MESI == E || MESI == S)
+           {
+	      c->stats.hitCount++;
+              PROFILE_TIME(timed, PROF_REPLACE, touchWay(policy, c, index, way, ways));
+           }
+           // if this tag exists MESI bits say invalid, needs to be set M
+           else
+           {
+              c->stats.missCount++;
+              c->stats.fills++;
+              PROFILE_TIME(timed, PROF_REPLACE, fillWay(policy, c, index, way, ways));
+           }
+        }
+        // if this tag simply doesn't exist in the cache in any form...
+        // this covers the very unlikely odd case where L1 has what L2 doesn't
+        else
+  	{
+	   c->stats.missCount++;
+           c->stats.fills++;
+	   PROFILE_TIME(timed, PROF_REPLACE, way = chooseVictim(policy, c, index, ways));
+           if (getMESI(c, index, way) == M)
+              c->stats.writebacks++;
+           c->set[index].tag[way] = tag;
+           PROFILE_TIME(timed, PROF_REPLACE, fillWay(policy, c, index, way, ways));
+        }
+        setMESI(c, index, way, M);
+        c->address[index * c->config.ways + way] = addr;
+      break;
+      // 4 snooped a read request from another processor
+      case 4:
+	c->stats.readCount++;
+        PROFILE_TIME(timed, PROF_LOOKUP, way = checkTagWays(c, index, tag, kWays));
+        // if the tag exists
+	if (way < MAXWAYS)
+	{
+	   int MESI = getMESI(c, index, way);
+	   // if this tag exists and is valid and modified per its MESI bits...
+	   if (MESI == M || MESI == E || MESI == S)
+	   {
+	      c->stats.hitCount++;
+	      // if modified, send copy to other cache, then L1, then to DRAM
+              if (MESI == M)
+                 c->stats.hitM++;
+              else
+                 c->stats.hit++;
+              // then set MESI to shared
+	      setMESI(c, index, way, S);
+              c->address[index * c->config.ways + way] = addr;
+           }
+	   // if the tag exists but it's invalid then we don't have it...
+           else
+              c->stats.missCount++;
+        }
+      break;
+      // 3 snooped invalidate command from another processor
+      // 5 snooped write request from another processor
+      case 3:
+      case 5:
+        if (n == 5)
+           c->stats.writeCount++;
+        PROFILE_TIME(timed, PROF_LOOKUP, way = checkTagWays(c, index, tag, kWays));
+        // if the tag exists...
+	if (way < MAXWAYS)
+	{
+	   int MESI = getMESI(c, index, way);
+	   if (MESI == M || MESI == E || MESI == S)
+              {
+                 c->stats.hitCount++;
+	         setMESI(c, index, way, I);
+                 c->address[index * c->config.ways + way] = addr;
+                 PROFILE_TIME(timed, PROF_REPLACE, touchWay(policy, c, index, way, ways));
+              }
+	   else
+              c->stats.missCount++;
+        }
+        else
+           c->stats.missCount++;
+      break;
+      // 6 snooped read for ownership request
+      case 6:
+	c->stats.readCount++;
+        PROFILE_TIME(timed, PROF_LOOKUP, way = checkTagWays(c, index, tag, kWays));
+        // if the tag exists
+	if (way < MAXWAYS)
+	{
+	   int MESI = getMESI(c, index, way);
+   	   // serve if modified tag exists, then invalidate
+	   if (MESI == M || MESI == E || MESI == S)
+           {
+              c->stats.hitCount++;
+              if (MESI == M) 
+                 c->stats.hitM++;
+              setMESI(c, index, way, I);
+              PROFILE_TIME(timed, PROF_REPLACE, touchWay(policy, c, index, way, ways));
+              c->address[index * c->config.ways + way] = addr;
+           }
+           else // if we don't have it, do nothing
+              c->stats.missCount++;         
+       }
+      break;
+      // 8 clear the cache entirely
+      case 8:
+        if (displayFile(c) != NULL)
+        {
+           fprintf(c->ofp,"Reference %lld called for the cache to be reset. No ways are valid.\n"
+                       "---------------------------------------------------------------------\n",
+                       c->stats.refCount);
+           fflush(c->ofp);
+        }
+        cacheReset(c);
+      break;
+      // 9 print the cache but change/destroy nothing
+      case 9:
+        if (displayFile(c) == NULL)
+           break;
+        fprintf(c->ofp,"Reference %lld displayed only indices containing valid ways.\n",
+                c->stats.refCount);
+        fflush(c->ofp);
+        cacheDisplay(c);
+        break;
+    } // end switch statement
+}
+
+// one reference, timed when the profile picks it, see profile.h
+static inline __attribute__((always_inline))
+void simulate(const int policy, const unsigned kWays, cache *c, int n, uint32_t addr)
+{
+#ifdef PROFILE
+  int sample = profileSample();
+  if (__builtin_expect(sample == PROFILE_WHOLE, 0))
+  {
+     uint64_t start = profileNow();
+     reference(policy, kWays, c, n, addr, 0);
+     profileRecord(PROF_REFERENCE, profileNow() - start);
+     return;
+  }
+  if (__builtin_expect(sample == PROFILE_PARTS, 0))
+  {
+     reference(policy, kWays, c, n, addr, 1);
+     return;
+  }
+#endif
+  reference(policy, kWays, c, n, addr, 0);
+}
+
+// the simulation kernels: one loop per replacement policy and geometry
+// shape, each with the policy and shape fixed at compile time
+// shape 0 is generic; shapes 1 to 5 are 1, 2, 4, 8 and 16 ways of 64-byte
+// lines in a power-of-two number of sets
+
+#define KERNEL(name, policy, kWays) \
+static void name(cache *c, const traceRecord *block, size_t count) \
+{ \
+  size_t i; \
+  for (i = 0; i < count; i++) \
+    simulate(policy, kWays, c, block[i].n, block[i].addr); \
+}
+
+#define KERNELS(name, policy) \
+KERNEL(name##Any, policy, 0) \
+KERNEL(name##1, policy, 1) \
+KERNEL(name##2, policy, 2) \
+KERNEL(name##4, policy, 4) \
+KERNEL(name##8, policy, 8) \
+KERNEL(name##16, policy, 16)
+
+#define SHAPES(name) { name##Any, name##1, name##2, name##4, name##8, name##16 }
+#define SHAPECOUNT 6
+
+KERNELS(runLRU, REPL_LRU)
+KERNELS(runPLRU, REPL_PLRU)
+KERNELS(runSRRIP, REPL_SRRIP)
+KERNELS(runBRRIP, REPL_BRRIP)
+KERNELS(runDRRIP, REPL_DRRIP)
+KERNELS(runFIFO, REPL_FIFO)
+KERNELS(runRandom, REPL_RANDOM)
+
+// indexed by REPL_* from replace.h and shape
+static const cacheKernel kernels[REPL_POLICIES][SHAPECOUNT] =
+{
+  SHAPES(runLRU), SHAPES(runPLRU), SHAPES(runSRRIP), SHAPES(runBRRIP),
+  SHAPES(runDRRIP), SHAPES(runFIFO), SHAPES(runRandom)
+};
+
+// use a specialized kernel if there is one for this geometry
+static void chooseKernel(cache *c)
+{
+  int shape = 0;
+  unsigned ways = c->config.ways;
+
+  if (!c->config.generic && c->pow2 && c->config.lineSize == 64 &&
+      (ways & (ways - 1)) == 0)
+     shape = 1 + __builtin_ctz(ways);
+  c->run = kernels[c->config.policy][shape];
+  c->kernelWays = shape ? ways : 0;
+}
+
+void cacheRun(cache *c, const traceRecord *block, size_t count)
+{
+  c->run(c, block, count);
+}
+
+// fill a line for a prefetcher as a read miss would, but with no reference
+// counted; returns where it went, index * ways + way as for c->address,
+// or -1 if the line was already valid
+int cachePrefetch(cache *c, uint32_t addr)
+{
+  uint32_t index, tag;
+  int way;
+
+  if (findLine(c, addr, &index, &tag, &way) != I)
+     return -1;
+  if (way == MAXWAYS)
+  {
+     way = chooseVictim(c->config.policy, c, index, c->config.ways);
+     if (getMESI(c, index, way) == M)
+        c->stats.writebacks++;
+  }
+  c->stats.fills++;
+  installLine(c->config.policy, c, addr, index, tag, way, E);
+  return index * c->config.ways + way;
+}
+
+// the one line summaries printed when several caches share a trace
+void cachePrintHeader()
+{
+  printf("%8s %4s %5s %4s %-6s %12s %12s %12s %12s %12s %9s\n",
+         "sets", "ways", "line", "bits", "policy", "references", "reads",
+         "writes", "hits", "misses", "hit ratio");
+}
+
+void cachePrintRow(const cacheConfig *cfg, const cacheStats *stats)
+{
+  float hitRatio = stats->refCount ? (float) stats->hitCount / stats->refCount : 0;
+
+  printf("%8u %4u %5u %4u %-6s %12lld %12lld %12lld %12lld %12lld %9f\n",
+         cfg->sets, cfg->ways, cfg->lineSize, cfg->addrBits,
+         replName(cfg->policy), stats->refCount, stats->readCount,
+         stats->writeCount, stats->hitCount, stats->missCount, hitRatio);
+}
+
+void cachePrintStats(const cache *c)
+{
+  // an empty trace, or -n 0, has no ratio to speak of
+  float hitRatio = c->stats.refCount ? (float) c->stats.hitCount / c->stats.refCount : 0;
+
+  printf(" Total References: %lld\n Reads: %lld\n Writes: %lld\n Hits: %lld\n"
+         " Misses %lld\n Hit ratio: %f\n Writebacks: %lld\n"
+         " Memory traffic: %lld bytes read, %lld bytes written\n"
+         "---------------------------------------------------------------------\n",
+         c->stats.refCount, c->stats.readCount, c->stats.writeCount,
+         c->stats.hitCount, c->stats.missCount, hitRatio, c->stats.writebacks,
+         c->stats.fills * c->config.lineSize, c->stats.writebacks * c->config.lineSize);
+}
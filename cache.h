@@ -0,0 +1,384 @@
+/* cache.h
+ *
+ * The set-associative MESI cache the simulator runs the trace against.
+ *
+ * A cache is created from a cacheConfig giving its geometry (number of
+ * sets, ways, line size and address width) and replacement policy, so
+ * one binary can simulate any of them. The tag, index and offset of an
+ * address are taken with shifts and masks when the sets and line size are
+ * powers of two and with multiply-by-reciprocal division otherwise.
+ *
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "trace.h"
+#include "tagmatch.h"
+#include "replace.h"
+
+#define M 0
+#define E 1
+#define S 2
+#define I 3
+
+// MESI and replacement state are packed 2 and 4 bits per way
+#define MAXWAYS TAGLANES
+
+typedef struct
+{
+  unsigned sets;       // number of indices, need not be a power of two
+  unsigned ways;       // 1 to MAXWAYS
+  unsigned lineSize;   // bytes per line
+  unsigned addrBits;   // address bits that are significant, at most 32
+  int policy;          // REPL_* from replace.h
+  int generic;         // never use a kernel specialized for the geometry
+} cacheConfig;
+
+// the geometry the simulator has always used: 16K lines of 64 bytes,
+// 16 ways, 32-bit addresses (the tag is addr >> 20)
+#define DEFAULT_SETS 16384
+#define DEFAULT_WAYS 16
+#define DEFAULT_LINESIZE 64
+#define DEFAULT_ADDRBITS 32
+
+// x / d for any 32-bit x without a divide instruction: a shift when d is a
+// power of two, otherwise a multiply by the 64-bit fixed point reciprocal
+typedef struct
+{
+  uint32_t d;
+  int shift;           // log2(d), or -1 when d is not a power of two
+  uint64_t magic;      // 2^64 / d rounded up
+} divider;
+
+// the cache is stored set by set: the 64 bytes of tags of a set are
+// contiguous, and the MESI and replacement state of every way is packed next
+// to them, 80 bytes a set in all; the set array starts on a host cache line
+// but only every fourth set does, so checkTag() reads one line or two
+// (padding sets to 128 bytes was measured no faster, and costs 60% more room)
+// MESIbits holds 2 bits per way, way w's state at bit 2w
+// repl is the replacement policy's state for the set, see replace.h
+// the tag array is always TAGLANES wide so tagMatch() can compare it whole
+// epoch is the cache's epoch when the set was last brought up to date: a
+// reset only starts a new epoch, and a set from an older one is reset the
+// first time it is touched (it fits in what would otherwise be padding)
+
+typedef struct
+{
+  uint32_t tag[TAGLANES];
+  uint64_t repl;
+  uint32_t MESIbits;
+  uint32_t epoch;
+} cacheSet;
+
+// counters for the final stats, updated by every reference
+typedef struct
+{
+  long long refCount;
+  long long readCount;
+  long long writeCount;
+  long long hitCount;
+  long long missCount;
+  long long hitM;
+  long long hit;
+  long long fills;          // lines read in from memory
+  long long writebacks;     // modified victims written back to memory
+} cacheStats;
+
+typedef struct cache cache;
+
+// runs a block of references through a cache, see cacheRun()
+typedef void (*cacheKernel)(cache *c, const traceRecord *block, size_t count);
+
+struct cache
+{
+  cacheConfig config;
+
+  // the simulation loop picked for this geometry and policy, and the
+  // number of ways it was specialized for (0 for the generic loop)
+  cacheKernel run;
+  unsigned kernelWays;
+
+  // address slicing, derived from the config
+  int pow2;            // sets and line size are both powers of two
+  unsigned offsetBits;
+  unsigned indexBits;
+  uint32_t indexMask;
+  uint32_t addrMask;
+  uint32_t wayMask;
+  divider lineDiv;
+  divider setDiv;
+
+  // the sets, addresses and occupancy bitmap below all live in one arena,
+  // allocated, or mapped from a checkpoint (map is then the whole file)
+  char *arena;
+  void *map;
+  size_t mapSize;
+
+  // one entry per index
+  cacheSet *set;
+
+  // the last address seen by each way, only needed by cacheDisplay()
+  // so it is kept apart from the lookup state
+  uint32_t *address;
+
+  // bumped by every reset, see cacheSet
+  uint32_t epoch;
+
+  // a bit per set, set while any of its ways is valid, so cacheDisplay()
+  // visits only occupied sets; kept up to date by setMESI()
+  uint64_t *occupied;
+
+  // where cacheDisplay() builds a snapshot before writing it out
+  char *displayBuf;
+  size_t displaySize;
+
+  // DRRIP's set dueling counter
+  int psel;
+
+  cacheStats stats;
+
+  // where op 9 appends its display and op 8 its notes; a cache created
+  // without a display name opens displayName when it is first needed
+  const char *displayName;
+  FILE *ofp;
+};
+
+// a checkpoint file is one page holding a checkpointHeader followed by the
+// cache's arena exactly as it is in memory, so it can only be restored on
+// a host like the one that wrote it
+
+#define CHECKPOINT_MAGIC "L2CK"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_PAGE 4096
+
+typedef struct
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t sets;
+  uint32_t ways;
+  uint32_t lineSize;
+  uint32_t addrBits;
+  int32_t policy;
+  uint32_t epoch;
+  int32_t psel;
+  uint32_t pad;
+  uint64_t refs;       // references of the trace already run
+  uint64_t arenaSize;
+  cacheStats stats;
+} checkpointHeader;
+
+int parseCount(const char *value, unsigned *count);
+void cacheDefaults(cacheConfig *cfg);
+int cacheConfigOption(cacheConfig *cfg, const char *key, const char *value);
+int cacheConfigSpec(cacheConfig *cfg, const char *spec);
+int cacheConfigFile(cacheConfig *cfg, const char *name);
+int cacheCreate(cache *c, const cacheConfig *cfg, const char *displayName);
+void cacheFree(cache *c);
+int cacheSave(const cache *c, const char *name, uint64_t refs);
+int cacheRestore(cache *c, const char *name, const cacheConfig *cfg,
+                 const char *displayName, uint64_t *refs);
+void cacheReset(cache *c);
+void cacheDisplay(cache *c);
+void cacheRun(cache *c, const traceRecord *block, size_t count);
+int cachePrefetch(cache *c, uint32_t addr);
+void cachePrintStats(const cache *c);
+void cachePrintHeader();
+void cachePrintRow(const cacheConfig *cfg, const cacheStats *stats);
+
+void makeDivider(divider *dv, uint32_t d);
+
+static inline uint32_t divide(const divider *dv, uint32_t x)
+{
+  if (dv->shift >= 0)
+     return x >> dv->shift;
+  return (uint32_t) (((unsigned __int128) dv->magic * x) >> 64);
+}
+
+// split an address into its index and tag
+// line64 is a constant 1 in kernels specialized for 64-byte lines and
+// power-of-two sets, where the offset is always the low 6 bits
+static inline __attribute__((always_inline))
+void splitAddress(const cache *c, uint32_t addr, uint32_t *index, uint32_t *tag,
+                  const int line64)
+{
+  addr &= c->addrMask;
+  if (line64)
+  {
+     uint32_t block = addr >> 6;
+     *index = block & c->indexMask;
+     *tag = block >> c->indexBits;
+  }
+  else if (c->pow2)
+  {
+     uint32_t block = addr >> c->offsetBits;
+     *index = block & c->indexMask;
+     *tag = block >> c->indexBits;
+  }
+  else
+  {
+     uint32_t block = divide(&c->lineDiv, addr);
+     *tag = divide(&c->setDiv, block);
+     *index = block - *tag * c->config.sets;
+  }
+}
+
+// the state of a set after a reset: tags cleared, every way invalid and
+// the replacement state as the policy starts it
+static inline void resetSet(cache *c, uint32_t index)
+{
+  cacheSet *s = &c->set[index];
+  unsigned way;
+  for (way = 0; way < c->config.ways; way++)
+     s->tag[way] = 0;
+  s->repl = replInit(c->config.policy, index);
+  s->MESIbits = 0xffffffff;
+  s->epoch = c->epoch;
+}
+
+// reset a set on its first touch since the cache was reset
+static inline __attribute__((always_inline))
+void freshenSet(cache *c, uint32_t index)
+{
+  if (__builtin_expect(c->set[index].epoch != c->epoch, 0))
+     resetSet(c, index);
+}
+
+static inline int getMESI(const cache *c, uint32_t index, int way)
+{
+  return (c->set[index].MESIbits >> (2 * way)) & 3;
+}
+
+static inline void setMESI(cache *c, uint32_t index, int way, int MESI)
+{
+  uint32_t m = (c->set[index].MESIbits & ~(3u << (2 * way)))
+               | ((uint32_t) MESI << (2 * way));
+  c->set[index].MESIbits = m;
+  // MESI is a constant at every call, so only one of these is compiled
+  // (ways past the cache's own are always I)
+  if (MESI != I)
+     c->occupied[index / 64] |= 1ull << (index % 64);
+  else if ((~(m & (m >> 1)) & 0x55555555) == 0)
+     c->occupied[index / 64] &= ~(1ull << (index % 64));
+}
+
+// returns a bitmask of the ways in the given index that are not invalid
+// a way is invalid when both of its MESI bits are set (I = 3)
+static inline uint32_t validWays(const cache *c, uint32_t index)
+{
+  uint32_t m = c->set[index].MESIbits;
+  uint32_t valid = ~(m & (m >> 1)) & 0x55555555;
+
+  // squeeze the even bits together, one bit per way
+  valid = (valid | (valid >> 1)) & 0x33333333;
+  valid = (valid | (valid >> 2)) & 0x0f0f0f0f;
+  valid = (valid | (valid >> 4)) & 0x00ff00ff;
+  valid = (valid | (valid >> 8)) & 0x0000ffff;
+  return valid & c->wayMask;
+}
+
+// compare the tag against the first kWays tags of a set
+// with kWays a constant below 8 the compare is unrolled and inlined, four
+// ways to an SSE2 compare; wider sets go through the tagMatch() dispatch,
+// whose AVX2 kernel does 8 ways a compare and wins despite the call
+// kWays of 0 means the cache's own number of ways, known only at run time
+static inline __attribute__((always_inline))
+uint32_t matchWays(const cache *c, const uint32_t *tags, uint32_t tag,
+                   const unsigned kWays)
+{
+  uint32_t mask = 0;
+  unsigned way = 0;
+
+  if (kWays == 0)
+     return tagMatch(tags, tag) & c->wayMask;
+  if (kWays >= 8)
+     return tagMatch(tags, tag) & ((1u << kWays) - 1);
+#ifdef __SSE2__
+  for (; way + 4 <= kWays; way += 4)
+  {
+     __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (tags + way)),
+                                  _mm_set1_epi32(tag));
+     mask |= (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(eq)) << way;
+  }
+#endif
+  for (; way < kWays; way++)
+     mask |= (uint32_t) (tags[way] == tag) << way;
+  return mask;
+}
+
+// check every way in the given index to see if the given tag exists
+// all ways are compared at once; a valid way holding the tag is returned
+// first, otherwise an invalid way still holding it so it can be reused
+// returns MAXWAYS if no way holds the tag
+static inline __attribute__((always_inline))
+int checkTagWays(const cache *c, uint32_t index, uint32_t tag, const unsigned kWays)
+{
+  uint32_t match = matchWays(c, c->set[index].tag, tag, kWays);
+  uint32_t hit = match & validWays(c, index);
+  if (hit)
+     return __builtin_ctz(hit);
+  if (match)
+     return __builtin_ctz(match);
+  return MAXWAYS;
+}
+
+static inline int checkTag(const cache *c, uint32_t index, uint32_t tag)
+{
+  return checkTagWays(c, index, tag, 0);
+}
+
+// the state of an address in a cache, and the index, tag and way of it,
+// for callers that keep several caches (see checkTag() for the way)
+static inline int findLine(cache *c, uint32_t addr, uint32_t *index, uint32_t *tag,
+                           int *way)
+{
+  splitAddress(c, addr, index, tag, 0);
+  freshenSet(c, *index);
+  *way = checkTag(c, *index, *tag);
+  return *way < MAXWAYS ? getMESI(c, *index, *way) : I;
+}
+
+// the replacement decisions, for the policy and number of ways the caller
+// was specialized for (both constants in the kernels)
+
+// given an index, this function returns the way to evict
+static inline __attribute__((always_inline))
+int chooseVictim(const int policy, cache *c, uint32_t index, const unsigned ways)
+{
+  return replVictim(policy, &c->set[index].repl, ways);
+}
+
+// a valid way was referenced
+static inline __attribute__((always_inline))
+void touchWay(const int policy, cache *c, uint32_t index, int way, const unsigned ways)
+{
+  replHit(policy, &c->set[index].repl, way, ways);
+}
+
+// a way was (re)filled after a miss
+static inline __attribute__((always_inline))
+void fillWay(const int policy, cache *c, uint32_t index, int way, const unsigned ways)
+{
+  replFill(policy, &c->set[index].repl, way, ways, index, &c->psel);
+}
+
+// bring a line into a way of the cache in the given state
+static inline __attribute__((always_inline))
+void installLine(const int policy, cache *c, uint32_t addr, uint32_t index,
+                 uint32_t tag, int way, int MESI)
+{
+  c->set[index].tag[way] = tag;
+  fillWay(policy, c, index, way, c->config.ways);
+  setMESI(c, index, way, MESI);
+  c->address[index * c->config.ways + way] = addr;
+}
+
+#endif
@@ -0,0 +1,346 @@
+/* classify.c
+ *
+ * Running a trace through a cache and a fully associative shadow of it,
+ * to sort the cache's misses into their kinds, see classify.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "classify.h"
+
+static const char *opNames[CLASSIFIED_OPS] = { "read", "write", "fetch" };
+
+static inline uint32_t hashOf(uint32_t line, uint32_t mask)
+{
+  return (line * 2654435761u) & mask;
+}
+
+// the set of lines referenced
+
+static void seenPut(classifier *k, uint32_t line)
+{
+  uint32_t mask = k->seenSize - 1;
+  uint32_t h = hashOf(line, mask);
+  while (k->seen[h] != 0)
+     h = (h + 1) & mask;
+  k->seen[h] = line + 1;
+}
+
+static int seenGrow(classifier *k)
+{
+  uint32_t *old = k->seen;
+  uint32_t oldSize = k->seenSize, i;
+
+  k->seenSize = oldSize ? 2 * oldSize : 1024;
+  k->seen = calloc(k->seenSize, sizeof (uint32_t));
+  if (k->seen == NULL)
+  {
+     fprintf(stderr, "cannot allocate the set of lines referenced\n");
+     k->seen = old;
+     k->seenSize = oldSize;
+     return -1;
+  }
+  for (i = 0; i < oldSize; i++)
+  {
+     if (old[i] != 0)
+        seenPut(k, old[i] - 1);
+  }
+  free(old);
+  return 0;
+}
+
+// returns 1 if the line was referenced before, otherwise adds it and
+// returns 0, or -1 if the set cannot grow
+static int seenBefore(classifier *k, uint32_t line)
+{
+  uint32_t mask = k->seenSize - 1;
+  uint32_t h = hashOf(line, mask);
+
+  while (k->seen[h] != 0)
+  {
+     if (k->seen[h] == line + 1)
+        return 1;
+     h = (h + 1) & mask;
+  }
+  if (2 * (k->seenCount + 1) > k->seenSize)
+  {
+     if (seenGrow(k) != 0)
+        return -1;
+  }
+  seenPut(k, line);
+  k->seenCount++;
+  return 0;
+}
+
+// the shadow's table from lines to their nodes
+
+static uint32_t shadowFind(const classifier *k, uint32_t line)
+{
+  uint32_t h = hashOf(line, k->mapMask);
+  while (k->map[h] != NO_LINE)
+  {
+     if (k->node[k->map[h]].line == line)
+        return k->map[h];
+     h = (h + 1) & k->mapMask;
+  }
+  return NO_LINE;
+}
+
+static void shadowPut(classifier *k, uint32_t line, uint32_t n)
+{
+  uint32_t h = hashOf(line, k->mapMask);
+  while (k->map[h] != NO_LINE)
+     h = (h + 1) & k->mapMask;
+  k->map[h] = n;
+}
+
+// take a line out of the table, moving later lines of its run back so
+// that every line can still be found from its hash
+static void shadowRemove(classifier *k, uint32_t line)
+{
+  uint32_t mask = k->mapMask;
+  uint32_t h = hashOf(line, mask), next, home;
+
+  while (k->node[k->map[h]].line != line)
+     h = (h + 1) & mask;
+  for (next = (h + 1) & mask; k->map[next] != NO_LINE; next = (next + 1) & mask)
+  {
+     home = hashOf(k->node[k->map[next]].line, mask);
+     // the line at next may fill the hole if its home is not between the
+     // hole and next, going round
+     if (((next - home) & mask) >= ((next - h) & mask))
+     {
+        k->map[h] = k->map[next];
+        h = next;
+     }
+  }
+  k->map[h] = NO_LINE;
+}
+
+// the shadow's list, most recently used at the head
+
+static void detach(classifier *k, uint32_t n)
+{
+  shadowLine *s = &k->node[n];
+  if (s->prev != NO_LINE)
+     k->node[s->prev].next = s->next;
+  else
+     k->head = s->next;
+  if (s->next != NO_LINE)
+     k->node[s->next].prev = s->prev;
+  else
+     k->tail = s->prev;
+}
+
+static void pushHead(classifier *k, uint32_t n)
+{
+  k->node[n].prev = NO_LINE;
+  k->node[n].next = k->head;
+  if (k->head != NO_LINE)
+     k->node[k->head].prev = n;
+  else
+     k->tail = n;
+  k->head = n;
+}
+
+static void pushTail(classifier *k, uint32_t n)
+{
+  k->node[n].next = NO_LINE;
+  k->node[n].prev = k->tail;
+  if (k->tail != NO_LINE)
+     k->node[k->tail].next = n;
+  else
+     k->head = n;
+  k->tail = n;
+}
+
+// a reference to a line: returns whether the shadow held it valid, and
+// whether a snoop had taken it, and leaves it the most recently used
+static int shadowReference(classifier *k, uint32_t line, int *invalidated)
+{
+  uint32_t n = shadowFind(k, line);
+  int hit;
+
+  *invalidated = 0;
+  if (n != NO_LINE)
+  {
+     hit = !k->node[n].invalid;
+     *invalidated = k->node[n].invalid;
+     detach(k, n);
+  }
+  else
+  {
+     hit = 0;
+     if (k->used < k->capacity)
+        n = k->used++;
+     else
+     {
+        n = k->tail;
+        detach(k, n);
+        shadowRemove(k, k->node[n].line);
+     }
+     k->node[n].line = line;
+     shadowPut(k, line, n);
+  }
+  k->node[n].invalid = 0;
+  pushHead(k, n);
+  return hit;
+}
+
+// a snoop took a line: it goes to the back, to be replaced first
+static void shadowInvalidate(classifier *k, uint32_t line)
+{
+  uint32_t n = shadowFind(k, line);
+  if (n == NO_LINE || k->node[n].invalid)
+     return;
+  k->node[n].invalid = 1;
+  detach(k, n);
+  pushTail(k, n);
+}
+
+// empty the shadow and forget every line referenced, as after a reset
+static void forget(classifier *k)
+{
+  memset(k->seen, 0, k->seenSize * sizeof (uint32_t));
+  k->seenCount = 0;
+  memset(k->map, 0xff, ((size_t) k->mapMask + 1) * sizeof (uint32_t));
+  k->used = 0;
+  k->head = k->tail = NO_LINE;
+}
+
+// returns -1, after saying why, if the shadow cannot be built
+int classifyCreate(classifier *k, cache *c)
+{
+  uint64_t lines = (uint64_t) c->config.sets * c->config.ways;
+  uint64_t size = 1024;
+
+  memset(k, 0, sizeof (classifier));
+  k->c = c;
+  if (lines >= 1u << 30)
+  {
+     fprintf(stderr, "too many lines to shadow\n");
+     return -1;
+  }
+  while (size < 2 * lines)
+     size *= 2;
+  k->capacity = lines;
+  k->mapMask = size - 1;
+  k->node = malloc(lines * sizeof (shadowLine));
+  k->map = malloc(size * sizeof (uint32_t));
+  if (k->node == NULL || k->map == NULL || seenGrow(k) != 0)
+  {
+     fprintf(stderr, "cannot allocate the shadow cache\n");
+     classifyFree(k);
+     return -1;
+  }
+  forget(k);
+  return 0;
+}
+
+void classifyFree(classifier *k)
+{
+  free(k->seen);
+  free(k->node);
+  free(k->map);
+  memset(k, 0, sizeof (classifier));
+}
+
+// one reference, through the cache and the shadow
+static int classify(classifier *k, const traceRecord *r)
+{
+  cache *c = k->c;
+  long long hits = c->stats.hitCount;
+  uint32_t line = divide(&c->lineDiv, r->addr & c->addrMask);
+  classStats *s;
+  int shadowHit, invalidated, before;
+
+  cacheRun(c, r, 1);
+  switch (r->n)
+  {
+    case 0:
+    case 1:
+    case 2:
+      s = &k->stats[r->n];
+      s->refs++;
+      shadowHit = shadowReference(k, line, &invalidated);
+      if (c->stats.hitCount != hits)
+         break;
+      s->misses++;
+      before = seenBefore(k, line);
+      if (before < 0)
+         return -1;
+      if (!before)
+         s->miss[MISS_COMPULSORY]++;
+      else if (invalidated)
+         s->miss[MISS_COHERENCE]++;
+      else if (!shadowHit)
+         s->miss[MISS_CAPACITY]++;
+      else
+         s->miss[MISS_CONFLICT]++;
+      break;
+    case 3:
+    case 5:
+    case 6:
+      k->snoops++;
+      shadowInvalidate(k, line);
+      break;
+    case 4:
+      k->snoops++;
+      break;
+    case 8:
+      forget(k);
+      break;
+  }
+  return 0;
+}
+
+// run the rest of a trace; returns -1 if it could not all be read or the
+// set of lines referenced grew too large
+int classifyRun(classifier *k, trace *t)
+{
+  const traceRecord *block;
+  size_t count, i;
+
+  while ((count = traceNext(t, &block)) > 0)
+  {
+     for (i = 0; i < count; i++)
+     {
+        if (classify(k, &block[i]) != 0)
+           return -1;
+     }
+  }
+  return t->error ? -1 : 0;
+}
+
+static void printRow(const char *name, const classStats *s)
+{
+  printf("%-6s %12lld %12lld %12lld %12lld %12lld %12lld\n", name, s->refs,
+         s->misses, s->miss[MISS_COMPULSORY], s->miss[MISS_CAPACITY],
+         s->miss[MISS_CONFLICT], s->miss[MISS_COHERENCE]);
+}
+
+void classifyPrintStats(const classifier *k)
+{
+  classStats total;
+  int op, m;
+
+  memset(&total, 0, sizeof (total));
+  printf("%-6s %12s %12s %12s %12s %12s %12s\n", "op", "references", "misses",
+         "compulsory", "capacity", "conflict", "coherence");
+  for (op = 0; op < CLASSIFIED_OPS; op++)
+  {
+     printRow(opNames[op], &k->stats[op]);
+     total.refs += k->stats[op].refs;
+     total.misses += k->stats[op].misses;
+     for (m = 0; m < MISS_CLASSES; m++)
+        total.miss[m] += k->stats[op].miss[m];
+  }
+  printRow("total", &total);
+  printf(" Snooped references, not classified: %lld\n"
+         " Lines referenced: %u, fully associative shadow of %u lines\n"
+         "---------------------------------------------------------------------\n",
+         k->snoops, k->seenCount, k->capacity);
+}
@@ -0,0 +1,93 @@
+/* classify.h
+ *
+ * Sorting the misses of a single cache into compulsory, capacity and
+ * conflict misses, to tell whether more sets or more ways would help.
+ *
+ * Alongside the cache runs a shadow cache of the same number of lines,
+ * fully associative and LRU. A miss is
+ *
+ *   compulsory  if its line was not referenced before, since the start
+ *               or the last reset
+ *   coherence   if a snooped invalidate (3, 5 or 6) took the line, and
+ *               the shadow still remembers it
+ *   capacity    otherwise, if the shadow misses too: no placement of that
+ *               many lines would have kept it
+ *   conflict    if the shadow hits: only the mapping to sets lost it
+ *
+ * The lines referenced so far are kept in a hash set of line numbers, and
+ * the shadow in a hash table of its lines and a list in order of use, so
+ * every reference costs the shadow a lookup and a move to the front of
+ * the list, whatever its size. A line invalidated by a snoop moves to the
+ * back, where it is the next to go, as an invalid way would be.
+ *
+ * Only the references that can miss and fill a line, 0, 1 and 2, are
+ * classified, and the counts are kept for each of them.
+ *
+ */
+
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <stdint.h>
+
+#include "trace.h"
+#include "cache.h"
+
+#define MISS_COMPULSORY 0
+#define MISS_CAPACITY 1
+#define MISS_CONFLICT 2
+#define MISS_COHERENCE 3
+#define MISS_CLASSES 4
+
+// the ops classified, 0 to 2
+#define CLASSIFIED_OPS 3
+
+// no entry, in a hash table or the shadow's list
+#define NO_LINE 0xffffffffu
+
+typedef struct
+{
+  long long refs;
+  long long misses;
+  long long miss[MISS_CLASSES];
+} classStats;
+
+// a line of the shadow cache, on a list from most to least recently used
+typedef struct
+{
+  uint32_t line;
+  uint32_t prev;
+  uint32_t next;
+  uint32_t invalid;    // taken by a snoop since it was last referenced
+} shadowLine;
+
+typedef struct
+{
+  cache *c;
+
+  // the lines referenced, stored as line + 1 so 0 is free, with linear
+  // probing; doubled whenever it is half full
+  uint32_t *seen;
+  uint32_t seenSize;
+  uint32_t seenCount;
+
+  // the shadow: capacity lines, a table from line to its index in node[]
+  // (NO_LINE where free) with linear probing, and the ends of the list
+  shadowLine *node;
+  uint32_t capacity;
+  uint32_t used;
+  uint32_t *map;
+  uint32_t mapMask;
+  uint32_t head;
+  uint32_t tail;
+
+  classStats stats[CLASSIFIED_OPS];
+  long long snoops;    // ops 3 to 6, not classified
+} classifier;
+
+int classifyCreate(classifier *k, cache *c);
+void classifyFree(classifier *k);
+int classifyRun(classifier *k, trace *t);
+void classifyPrintStats(const classifier *k);
+
+#endif
@@ -0,0 +1,645 @@
+/* coherence.c
+ *
+ * The snooping bus, its snoop filter and the MESI transitions of the
+ * cores' caches, see coherence.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coherence.h"
+
+// the snoop filter
+
+static inline uint64_t filterSlot(const snoopFilter *f, uint32_t block)
+{
+  return ((uint64_t) block * 0x9e3779b97f4a7c15ull) >> (64 - f->bits);
+}
+
+static inline int filterLive(const snoopFilter *f, const filterEntry *e)
+{
+  return e->epoch == f->epoch && e->sharers != 0;
+}
+
+// the entry of a block, or NULL if no core holds it
+static inline filterEntry *filterFind(snoopFilter *f, uint32_t block)
+{
+  uint64_t i;
+  for (i = filterSlot(f, block); ; i = (i + 1) & f->mask)
+  {
+     filterEntry *e = &f->entry[i];
+     if (!filterLive(f, e))
+        return NULL;
+     if (e->block == block)
+        return e;
+  }
+}
+
+// the table is never more than half full, so there is always a free slot
+static inline void filterAdd(snoopFilter *f, uint32_t block, int core)
+{
+  uint64_t i;
+  for (i = filterSlot(f, block); ; i = (i + 1) & f->mask)
+  {
+     filterEntry *e = &f->entry[i];
+     if (!filterLive(f, e))
+     {
+        e->block = block;
+        e->epoch = f->epoch;
+        e->sharers = 1ull << core;
+        return;
+     }
+     if (e->block == block)
+     {
+        e->sharers |= 1ull << core;
+        return;
+     }
+  }
+}
+
+// take cores off a block's sharers; a block no core holds any more is
+// deleted by shifting back the entries that probed past it, so no
+// tombstones are left behind
+static void filterRemove(snoopFilter *f, filterEntry *e, uint64_t cores)
+{
+  uint64_t i, j, home;
+
+  e->sharers &= ~cores;
+  if (e->sharers != 0)
+     return;
+  i = j = e - f->entry;
+  for (;;)
+  {
+     j = (j + 1) & f->mask;
+     if (!filterLive(f, &f->entry[j]))
+        break;
+     // an entry whose home slot is cyclically in (i, j] stays put
+     home = filterSlot(f, f->entry[j].block);
+     if (i <= j ? i < home && home <= j : i < home || home <= j)
+        continue;
+     f->entry[i] = f->entry[j];
+     i = j;
+  }
+  f->entry[i].sharers = 0;
+}
+
+// forget every block, as the caches do on a reset
+static void filterReset(snoopFilter *f)
+{
+  f->epoch++;
+  if (f->epoch == 0)
+  {
+     memset(f->entry, 0, (f->mask + 1) * sizeof (filterEntry));
+     f->epoch = 1;
+  }
+}
+
+// the cores' caches, which all have the same geometry
+
+static inline uint32_t blockOf(const cache *c, uint32_t index, uint32_t tag)
+{
+  return tag * c->config.sets + index;
+}
+
+// a transaction seen by the given cores: an M copy is flushed, then every
+// copy either drops to S or is invalidated; returns the cores that had one
+static uint64_t snoop(coherence *h, uint32_t addr, uint64_t cores, int invalidate)
+{
+  uint32_t index, tag;
+  uint64_t held = 0;
+  int way, MESI, q;
+
+  for (; cores != 0; cores &= cores - 1)
+  {
+     q = __builtin_ctzll(cores);
+     MESI = findLine(&h->core[q], addr, &index, &tag, &way);
+     h->bus.snoops++;
+     if (MESI == I)
+        continue;
+     held |= 1ull << q;
+     if (MESI == M)
+        h->bus.flushes++;
+     if (invalidate)
+     {
+        setMESI(&h->core[q], index, way, I);
+        h->bus.invalidations++;
+     }
+     else if (MESI != S)
+        setMESI(&h->core[q], index, way, S);
+  }
+  return held;
+}
+
+// pick the way of core p's cache a missing line goes in: a way still
+// holding the tag is reused, then an invalid way, and only then does the
+// policy choose a victim, written back if modified
+// the victim leaves the snoop filter, or is reported to the directory
+static inline __attribute__((always_inline))
+int makeRoom(const int policy, const int useDirectory, coherence *h, int p,
+             uint32_t index, int way)
+{
+  cache *c = &h->core[p];
+  uint32_t invalid, block;
+  int dirty;
+
+  if (way < MAXWAYS)
+     return way;
+  invalid = ~validWays(c, index) & c->wayMask;
+  if (invalid)
+     return __builtin_ctz(invalid);
+
+  way = chooseVictim(policy, c, index, c->config.ways);
+  block = blockOf(c, index, c->set[index].tag[way]);
+  dirty = getMESI(c, index, way) == M;
+  if (dirty)
+     h->bus.writebacks++;
+  if (useDirectory)
+  {
+     dirEntry *e = dirFind(&h->dir, block);
+     if (dirty)
+        h->dir.stats.writebacks++;
+     else
+        h->dir.stats.hints++;
+     if (e != NULL)
+        dirRemoveSharer(&h->dir, e, p);
+  }
+  else
+  {
+     filterEntry *e = filterFind(&h->filter, block);
+     if (e != NULL)
+        filterRemove(&h->filter, e, 1ull << p);
+  }
+  // gone before the new line arrives, should anything snoop it meanwhile
+  setMESI(c, index, way, I);
+  return way;
+}
+
+// the directory invalidates the given cores' copies, each acknowledging
+// whether it had one; returns the cores that did
+static uint64_t invalidateCores(coherence *h, uint32_t addr, uint64_t cores)
+{
+  long long flushes = h->bus.flushes;
+  int sent = __builtin_popcountll(cores);
+  uint64_t held = snoop(h, addr, cores, 1);
+
+  h->dir.stats.invalidations += sent;
+  h->dir.stats.acks += sent;
+  h->dir.stats.spurious += sent - __builtin_popcountll(held);
+  h->dir.stats.writebacks += h->bus.flushes - flushes;
+  return held;
+}
+
+// a directory entry for a block that has none, recalling the copies the
+// entry evicted for it was tracking
+static dirEntry *newEntry(coherence *h, uint32_t block)
+{
+  dirEntry victim;
+  int evicted;
+  dirEntry *e = dirAllocate(&h->dir, block, &victim, &evicted);
+
+  if (evicted)
+  {
+     uint64_t held = invalidateCores(h, victim.block * h->core[0].config.lineSize,
+                                     dirTargets(&h->dir, &victim));
+     h->dir.stats.recalls += __builtin_popcountll(held);
+  }
+  return e;
+}
+
+// the owner of a line forwards it, dropping to S, or invalidated when the
+// requester is to own it; the directory gets the line back if it was M
+static void forward(coherence *h, uint32_t addr, int owner, int invalidate)
+{
+  long long flushes = h->bus.flushes;
+
+  h->dir.stats.forwards++;
+  h->dir.stats.data++;
+  snoop(h, addr, 1ull << owner, invalidate);
+  if (!invalidate)
+  {
+     if (h->bus.flushes != flushes)
+        h->dir.stats.writebacks++;
+     else
+        h->dir.stats.acks++;
+  }
+}
+
+// carry out one reference of the trace
+// policy and useDirectory are constants in every caller, so each kernel
+// below gets its own copy of this with the replacement policy inlined and
+// only one of the two protocols
+static inline __attribute__((always_inline))
+void step(const int policy, const int useDirectory, coherence *h, int p, int n,
+          uint32_t addr)
+{
+  cache *c = &h->core[p];
+  snoopFilter *f = &h->filter;
+  directory *d = &h->dir;
+  filterEntry *fe;
+  dirEntry *de;
+  uint32_t index, tag, block;
+  uint64_t others;
+  int way, MESI, q;
+
+  h->refCount++;
+  switch (n)
+  {
+    // n = 0 read data, n = 2 instruction fetch
+    case 0:
+    case 2:
+      MESI = findLine(c, addr, &index, &tag, &way);
+      c->stats.refCount++;
+      c->stats.readCount++;
+      if (MESI != I)
+      {
+         c->stats.hitCount++;
+         touchWay(policy, c, index, way, c->config.ways);
+         c->address[index * c->config.ways + way] = addr;
+         break;
+      }
+      c->stats.missCount++;
+      h->bus.busRd++;
+      block = blockOf(c, index, tag);
+      if (useDirectory)
+      {
+         d->stats.requests++;
+         way = makeRoom(policy, 1, h, p, index, way);
+         de = dirFind(d, block);
+         if (de == NULL)
+         {
+            // no other copy, memory sends the line exclusive
+            de = newEntry(h, block);
+            dirSetOwner(de, p);
+            d->stats.data++;
+            h->bus.memReads++;
+            MESI = E;
+         }
+         else if (de->owner != DIR_NONE)
+         {
+            dirTouch(d, de);
+            q = de->owner;
+            forward(h, addr, q, 0);
+            h->bus.transfers++;
+            de->owner = DIR_NONE;
+            dirAddSharer(d, de, q);
+            dirAddSharer(d, de, p);
+            MESI = S;
+         }
+         else
+         {
+            // shared, memory has it up to date
+            dirTouch(d, de);
+            dirAddSharer(d, de, p);
+            d->stats.data++;
+            h->bus.memReads++;
+            MESI = S;
+         }
+         installLine(policy, c, addr, index, tag, way, MESI);
+         break;
+      }
+      fe = filterFind(f, block);
+      others = fe != NULL ? fe->sharers : 0;
+      if (others)
+      {
+         snoop(h, addr, others, 0);
+         h->bus.transfers++;
+      }
+      else
+         h->bus.memReads++;
+      way = makeRoom(policy, 0, h, p, index, way);
+      installLine(policy, c, addr, index, tag, way, others ? S : E);
+      filterAdd(f, block, p);
+      break;
+    // n = 1 write data
+    case 1:
+      MESI = findLine(c, addr, &index, &tag, &way);
+      c->stats.refCount++;
+      c->stats.writeCount++;
+      block = blockOf(c, index, tag);
+      if (MESI != I)
+      {
+         c->stats.hitCount++;
+         touchWay(policy, c, index, way, c->config.ways);
+         // a shared line has to invalidate the other copies first, an
+         // exclusive one is written without telling anyone
+         if (MESI == S)
+         {
+            h->bus.busUpgr++;
+            if (useDirectory)
+            {
+               d->stats.requests++;
+               de = dirFind(d, block);
+               dirTouch(d, de);
+               invalidateCores(h, addr, dirTargets(d, de) & ~(1ull << p));
+               // and the grant
+               d->stats.acks++;
+               dirSetOwner(de, p);
+            }
+            else
+            {
+               fe = filterFind(f, block);
+               others = fe->sharers & ~(1ull << p);
+               snoop(h, addr, others, 1);
+               filterRemove(f, fe, others);
+            }
+         }
+         if (MESI != M)
+            setMESI(c, index, way, M);
+         c->address[index * c->config.ways + way] = addr;
+         break;
+      }
+      c->stats.missCount++;
+      h->bus.busRdX++;
+      if (useDirectory)
+      {
+         d->stats.requests++;
+         way = makeRoom(policy, 1, h, p, index, way);
+         de = dirFind(d, block);
+         if (de == NULL)
+            de = newEntry(h, block);
+         else
+            dirTouch(d, de);
+         if (de->owner != DIR_NONE)
+         {
+            forward(h, addr, de->owner, 1);
+            h->bus.transfers++;
+         }
+         else
+         {
+            invalidateCores(h, addr, dirTargets(d, de) & ~(1ull << p));
+            d->stats.data++;
+            h->bus.memReads++;
+         }
+         dirSetOwner(de, p);
+         installLine(policy, c, addr, index, tag, way, M);
+         break;
+      }
+      fe = filterFind(f, block);
+      others = fe != NULL ? fe->sharers : 0;
+      if (others)
+      {
+         snoop(h, addr, others, 1);
+         filterRemove(f, fe, others);
+         h->bus.transfers++;
+      }
+      else
+         h->bus.memReads++;
+      way = makeRoom(policy, 0, h, p, index, way);
+      installLine(policy, c, addr, index, tag, way, M);
+      filterAdd(f, block, p);
+      break;
+    // 3 invalidate, 4 read, 5 write and 6 read for ownership by some
+    // other agent on the bus
+    case 3:
+    case 4:
+    case 5:
+    case 6:
+      h->bus.external++;
+      splitAddress(c, addr, &index, &tag, 0);
+      block = blockOf(c, index, tag);
+      if (useDirectory)
+      {
+         d->stats.requests++;
+         de = dirFind(d, block);
+         if (de == NULL)
+            break;
+         if (n != 4)
+         {
+            invalidateCores(h, addr, dirTargets(d, de));
+            dirRelease(d, de);
+         }
+         else if (de->owner != DIR_NONE)
+         {
+            dirTouch(d, de);
+            q = de->owner;
+            forward(h, addr, q, 0);
+            de->owner = DIR_NONE;
+            dirAddSharer(d, de, q);
+         }
+         break;
+      }
+      fe = filterFind(f, block);
+      if (fe != NULL)
+      {
+         others = fe->sharers;
+         snoop(h, addr, others, n != 4);
+         if (n != 4)
+            filterRemove(f, fe, others);
+      }
+      break;
+    // 8 clear every cache
+    case 8:
+      for (q = 0; q < h->cores; q++)
+      {
+         fprintf(h->core[q].ofp, "Reference %lld called for the cache to be reset. "
+                 "No ways are valid.\n"
+                 "---------------------------------------------------------------------\n",
+                 h->refCount);
+         fflush(h->core[q].ofp);
+         cacheReset(&h->core[q]);
+      }
+      if (useDirectory)
+         dirReset(d);
+      else
+         filterReset(f);
+      break;
+    // 9 print every cache but change nothing
+    case 9:
+      for (q = 0; q < h->cores; q++)
+      {
+         fprintf(h->core[q].ofp, "Reference %lld displayed only indices containing "
+                 "valid ways.\n", h->refCount);
+         cacheDisplay(&h->core[q]);
+      }
+      break;
+  }
+}
+
+static int badCore(const coherence *h, int core)
+{
+  fprintf(stderr, "reference %lld is from core %d, but there are only %d cores\n",
+          h->refCount + 1, core, h->cores);
+  return -1;
+}
+
+#define KERNEL(name, policy, useDirectory) \
+static int name(coherence *h, const traceRecord *block, size_t count, int cores) \
+{ \
+  size_t i; \
+  int p; \
+  for (i = 0; i < count; i++) \
+  { \
+    p = cores ? block[i].core : 0; \
+    if (p >= h->cores) \
+      return badCore(h, p); \
+    step(policy, useDirectory, h, p, block[i].n, block[i].addr); \
+  } \
+  return 0; \
+}
+
+#define KERNELS(name, policy) \
+KERNEL(name##Snoop, policy, 0) \
+KERNEL(name##Directory, policy, 1)
+
+KERNELS(runLRU, REPL_LRU)
+KERNELS(runPLRU, REPL_PLRU)
+KERNELS(runSRRIP, REPL_SRRIP)
+KERNELS(runBRRIP, REPL_BRRIP)
+KERNELS(runDRRIP, REPL_DRRIP)
+KERNELS(runFIFO, REPL_FIFO)
+KERNELS(runRandom, REPL_RANDOM)
+
+// indexed by whether there is a directory and REPL_* from replace.h
+static const coherenceKernel kernels[2][REPL_POLICIES] =
+{
+  { runLRUSnoop, runPLRUSnoop, runSRRIPSnoop, runBRRIPSnoop, runDRRIPSnoop,
+    runFIFOSnoop, runRandomSnoop },
+  { runLRUDirectory, runPLRUDirectory, runSRRIPDirectory, runBRRIPDirectory,
+    runDRRIPDirectory, runFIFODirectory, runRandomDirectory }
+};
+
+// create the given number of cores, each with a cache described by cfg
+// displaying to display-coreN.txt, kept coherent by the directory dcfg
+// describes or, if it is NULL, by snooping
+// returns -1, after saying why, if it cannot
+int coherenceCreate(coherence *h, const cacheConfig *cfg, int cores,
+                    const dirConfig *dcfg)
+{
+  uint64_t lines, slots = 64;
+  int p;
+
+  memset(h, 0, sizeof (coherence));
+  if (cores < 1 || cores > MAXCORES)
+  {
+     fprintf(stderr, "cores must be 1 to %d\n", MAXCORES);
+     return -1;
+  }
+  h->core = calloc(cores, sizeof (cache));
+  h->displayName = calloc(cores, sizeof (*h->displayName));
+  if (h->core == NULL || h->displayName == NULL)
+  {
+     fprintf(stderr, "cannot allocate %d cores\n", cores);
+     coherenceFree(h);
+     return -1;
+  }
+
+  if (dcfg != NULL)
+  {
+     if (dirCreate(&h->dir, dcfg, cfg, cores) != 0)
+     {
+        coherenceFree(h);
+        return -1;
+     }
+     h->useDirectory = 1;
+  }
+  else
+  {
+     lines = (uint64_t) cores * cfg->sets * cfg->ways;
+     while (slots < 2 * lines)
+        slots <<= 1;
+     h->filter.entry = calloc(slots, sizeof (filterEntry));
+     if (h->filter.entry == NULL)
+     {
+        fprintf(stderr, "cannot allocate the snoop filter\n");
+        coherenceFree(h);
+        return -1;
+     }
+     h->filter.mask = slots - 1;
+     h->filter.bits = __builtin_ctzll(slots);
+     h->filter.epoch = 1;
+  }
+
+  for (p = 0; p < cores; p++)
+  {
+     sprintf(h->displayName[p], "display-core%d.txt", p);
+     if (cacheCreate(&h->core[p], cfg, h->displayName[p]) != 0)
+     {
+        coherenceFree(h);
+        return -1;
+     }
+     h->cores++;
+  }
+  h->run = kernels[h->useDirectory][cfg->policy];
+  return 0;
+}
+
+void coherenceFree(coherence *h)
+{
+  int p;
+  for (p = 0; p < h->cores; p++)
+     cacheFree(&h->core[p]);
+  free(h->core);
+  free(h->displayName);
+  free(h->filter.entry);
+  if (h->useDirectory)
+     dirFree(&h->dir);
+  memset(h, 0, sizeof (coherence));
+}
+
+// run the rest of the trace; a version 1 binary trace has no core ids and
+// is all core 0
+int coherenceRun(coherence *h, trace *t)
+{
+  const traceRecord *block;
+  size_t count;
+
+  while ((count = traceNext(t, &block)) > 0)
+  {
+     if (h->run(h, block, count, t->cores) != 0)
+        return -1;
+  }
+  return t->error ? -1 : 0;
+}
+
+void coherencePrintStats(const coherence *h)
+{
+  const busStats *b = &h->bus;
+  const dirStats *d = &h->dir.stats;
+  long long transactions = b->busRd + b->busRdX + b->busUpgr;
+  int p;
+
+  printf("%4s ", "core");
+  cachePrintHeader();
+  for (p = 0; p < h->cores; p++)
+  {
+     printf("%4d ", p);
+     cachePrintRow(&h->core[p].config, &h->core[p].stats);
+  }
+  if (!h->useDirectory)
+  {
+     printf(" Total References: %lld\n BusRd: %lld\n BusRdX: %lld\n BusUpgr: %lld\n"
+            " Other agents' transactions: %lld\n Cache to cache transfers: %lld\n"
+            " Memory reads: %lld\n Snoop flushes: %lld\n Writebacks: %lld\n"
+            " Invalidations: %lld\n Snoops: %lld (%lld without the filter)\n"
+            "---------------------------------------------------------------------\n",
+            h->refCount, b->busRd, b->busRdX, b->busUpgr, b->external, b->transfers,
+            b->memReads, b->flushes, b->writebacks, b->invalidations, b->snoops,
+            transactions * (h->cores - 1) + b->external * h->cores);
+     return;
+  }
+
+  printf(" Total References: %lld\n GetS: %lld\n GetM: %lld\n Upgrades: %lld\n"
+         " Other agents' requests: %lld\n Cache to cache transfers: %lld\n"
+         " Memory reads: %lld\n Owner flushes: %lld\n Writebacks: %lld\n"
+         " Invalidations: %lld\n Caches probed: %lld\n",
+         h->refCount, b->busRd, b->busRdX, b->busUpgr, b->external, b->transfers,
+         b->memReads, b->flushes, b->writebacks, b->invalidations, b->snoops);
+  printf(" Directory: %u entries, %u ways, %s sharers",
+         h->dir.config.entries, h->dir.config.ways, dirName(h->dir.config.sharers));
+  if (h->dir.config.sharers == DIR_COARSE)
+     printf(" of %u cores a bit", h->dir.config.group);
+  else if (h->dir.config.sharers == DIR_POINTERS)
+     printf(", %u pointers", h->dir.config.pointers);
+  printf("\n Directory evictions: %lld (%lld copies recalled)\n"
+         " Messages: %lld\n   Requests: %lld\n   Forwards: %lld\n   Data: %lld\n"
+         "   Invalidations: %lld (%lld to cores without a copy)\n   Acks: %lld\n"
+         "   Writebacks: %lld\n   Eviction hints: %lld\n"
+         "---------------------------------------------------------------------\n",
+         d->evictions, d->recalls,
+         d->requests + d->forwards + d->data + d->invalidations + d->acks +
+         d->writebacks + d->hints,
+         d->requests, d->forwards, d->data, d->invalidations, d->spurious, d->acks,
+         d->writebacks, d->hints);
+}
@@ -0,0 +1,109 @@
+/* coherence.h
+ *
+ * Several cores, each with a private cache, kept coherent with MESI on a
+ * snooping bus.
+ *
+ * Every reference carries the id of the core that made it. Reads (0, 2)
+ * and writes (1) go to that core's cache; a miss, or a write to a shared
+ * line, is put on the bus and snooped by the other caches:
+ *
+ *   read miss    BusRd    an M copy is flushed to memory, M and E copies
+ *                         drop to S; the line is filled S if any other
+ *                         cache had it, otherwise E
+ *   write miss   BusRdX   an M copy is flushed, every copy is invalidated,
+ *                         the line is filled M
+ *   write to S   BusUpgr  every other copy is invalidated, the line goes M
+ *   write to E            the line goes M without a bus transaction
+ *
+ * A modified line chosen as a victim is written back. The snooped ops of
+ * the trace (3, 4, 5, 6) become transactions of some other agent on the
+ * bus, seen by every core, and 8 and 9 reset and display every core.
+ *
+ * Only the caches holding a line are probed: a snoop filter maps every
+ * line held anywhere to the bitmask of the cores holding it, kept exact as
+ * lines are filled, evicted and invalidated. It is an open addressed table
+ * with room for twice the lines of all the caches, and a reset starts a new
+ * epoch instead of clearing it, as the caches do.
+ *
+ * The cores can instead be kept coherent by a sparse directory, see
+ * directory.h, which also counts the messages the protocol sends.
+ *
+ */
+
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <stdint.h>
+
+#include "trace.h"
+#include "cache.h"
+#include "directory.h"
+
+// the sharers of a line are a 64-bit mask
+#define MAXCORES 64
+
+// bus traffic over all cores; with a directory the same transactions are
+// sent to it instead
+typedef struct
+{
+  long long busRd;          // read misses
+  long long busRdX;         // write misses
+  long long busUpgr;        // writes to shared lines
+  long long transfers;      // misses another cache held the line for
+  long long memReads;       // misses filled from memory
+  long long flushes;        // modified lines written back when snooped
+  long long writebacks;     // modified victims written back
+  long long invalidations;  // copies invalidated
+  long long snoops;         // caches probed, with or without a copy
+  long long external;       // transactions of other agents, ops 3 to 6
+} busStats;
+
+// one line held somewhere: it is live only while epoch is the filter's
+// and some core holds it
+typedef struct
+{
+  uint32_t block;
+  uint32_t epoch;
+  uint64_t sharers;
+} filterEntry;
+
+typedef struct
+{
+  filterEntry *entry;
+  uint64_t mask;            // slots - 1
+  int bits;                 // log2(slots)
+  uint32_t epoch;
+} snoopFilter;
+
+typedef struct coherence coherence;
+
+// runs a block of references through the cores, see coherenceRun()
+// cores says whether the records' core ids are to be used
+typedef int (*coherenceKernel)(coherence *h, const traceRecord *block, size_t count,
+                               int cores);
+
+struct coherence
+{
+  int cores;
+  cache *core;
+
+  // the snoop filter, or the directory when useDirectory is set
+  snoopFilter filter;
+  int useDirectory;
+  directory dir;
+
+  busStats bus;
+  long long refCount;
+  char (*displayName)[32];
+
+  // the loop for the caches' replacement policy
+  coherenceKernel run;
+};
+
+int coherenceCreate(coherence *h, const cacheConfig *cfg, int cores,
+                    const dirConfig *dcfg);
+void coherenceFree(coherence *h);
+int coherenceRun(coherence *h, trace *t);
+void coherencePrintStats(const coherence *h);
+
+#endif
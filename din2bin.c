@@ -0,0 +1,89 @@
+/* din2bin.c
+ *
+ * Converts a text trace of 'n address [core]' lines (see testfile.din)
+ * into the packed binary trace format described in trace.h, so that main
+ * can map it instead of parsing it on every run. A version 1 binary trace
+ * is brought up to the current version, its references all from core 0.
+ *
+ * usage: din2bin input.din output.bin
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+int main(int argc, char *argv[])
+{
+  trace t;
+  traceHeader h;
+  const traceRecord *block;
+  static traceRecord out[TRACE_BLOCK];
+  size_t count, i;
+  char tmp[4096];
+  FILE *ofp;
+  int err = 0;
+
+  if (argc != 3)
+  {
+     fprintf(stderr, "usage: %s input.din output.bin\n", argv[0]);
+     return 1;
+  }
+
+  if (traceOpen(&t, argv[1]) != 0)
+  {
+     fprintf(stderr, "%s: cannot read trace\n", argv[1]);
+     return 1;
+  }
+  // written under another name and renamed when complete, so that a
+  // malformed input or a failed write never leaves a trace that looks whole
+  if (snprintf(tmp, sizeof (tmp), "%s.tmp", argv[2]) >= (int) sizeof (tmp) ||
+      (ofp = fopen(tmp, "wb")) == NULL)
+  {
+     fprintf(stderr, "%s: cannot create\n", argv[2]);
+     return 1;
+  }
+
+  // write the header now and come back for the count at the end
+  memset(&h, 0, sizeof (h));
+  memcpy(h.magic, TRACE_MAGIC, 4);
+  h.version = TRACE_VERSION;
+  fwrite(&h, sizeof (h), 1, ofp);
+
+  while ((count = traceNext(&t, &block)) > 0)
+  {
+     // the core ids and padding as this version has them
+     for (i = 0; i < count; i++)
+        out[i] = (traceRecord) { .addr = block[i].addr, .n = block[i].n,
+                                 .core = t.cores ? block[i].core : 0 };
+     if (fwrite(out, sizeof (traceRecord), count, ofp) != count)
+     {
+        err = 1;
+        break;
+     }
+     h.count += count;
+  }
+
+  if (!err && !t.error)
+  {
+     fseek(ofp, 0, SEEK_SET);
+     err = fwrite(&h, sizeof (h), 1, ofp) != 1;
+  }
+  err |= fclose(ofp) != 0;
+  if (err || t.error || rename(tmp, argv[2]) != 0)
+  {
+     // traceNext() has said what was wrong with the input
+     if (!t.error)
+        fprintf(stderr, "%s: write failed\n", argv[2]);
+     unlink(tmp);
+     traceClose(&t);
+     return 1;
+  }
+  traceClose(&t);
+
+  printf("%llu references written to %s\n", (unsigned long long) h.count, argv[2]);
+  return 0;
+}
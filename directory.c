@@ -0,0 +1,178 @@
+/* directory.c
+ *
+ * Creating the sparse directory and allocating and releasing its entries,
+ * see directory.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "directory.h"
+
+static const char *const dirNames[] = { "full", "coarse", "pointers" };
+
+const char *dirName(int sharers)
+{
+  return dirNames[sharers];
+}
+
+void dirDefaults(dirConfig *cfg)
+{
+  cfg->entries = 0;
+  cfg->ways = 8;
+  cfg->sharers = DIR_FULL;
+  cfg->group = 4;
+  cfg->pointers = 4;
+}
+
+// apply a comma separated list of key=value settings, e.g.
+// "entries=64K,ways=16,sharers=pointers,pointers=4"
+int dirConfigSpec(dirConfig *cfg, const char *spec)
+{
+  char buf[256];
+  char *item, *value, *save;
+  int i, err;
+
+  if (strlen(spec) >= sizeof (buf))
+     return -1;
+  strcpy(buf, spec);
+  for (item = strtok_r(buf, ",", &save); item != NULL;
+       item = strtok_r(NULL, ",", &save))
+  {
+     value = strchr(item, '=');
+     if (value == NULL)
+        return -1;
+     *value++ = '\0';
+     if (strcmp(item, "entries") == 0)
+        err = parseCount(value, &cfg->entries);
+     else if (strcmp(item, "ways") == 0)
+        err = parseCount(value, &cfg->ways);
+     else if (strcmp(item, "group") == 0)
+        err = parseCount(value, &cfg->group);
+     else if (strcmp(item, "pointers") == 0)
+        err = parseCount(value, &cfg->pointers);
+     else if (strcmp(item, "sharers") == 0)
+     {
+        err = -1;
+        for (i = 0; i < 3; i++)
+        {
+           if (strcmp(value, dirNames[i]) == 0)
+           {
+              cfg->sharers = i;
+              err = 0;
+           }
+        }
+     }
+     else
+        err = -1;
+     if (err != 0)
+        return -1;
+  }
+  return 0;
+}
+
+// allocate the directory cfg describes for the given cores, each with a
+// cache like cacheCfg; returns -1, after saying why, if it cannot
+int dirCreate(directory *d, const dirConfig *cfg, const cacheConfig *cacheCfg, int cores)
+{
+  uint64_t entries = cfg->entries;
+
+  memset(d, 0, sizeof (directory));
+  d->config = *cfg;
+  if (entries == 0)
+     entries = (uint64_t) cores * cacheCfg->sets * cacheCfg->ways;
+  if (cfg->ways < 1 || cfg->ways > MAXWAYS)
+  {
+     fprintf(stderr, "directory ways must be 1 to %d\n", MAXWAYS);
+     return -1;
+  }
+  if (cfg->sharers == DIR_COARSE && (cfg->group < 1 || cfg->group > 64))
+  {
+     fprintf(stderr, "a coarse vector's groups must be 1 to 64 cores\n");
+     return -1;
+  }
+  if (cfg->sharers == DIR_POINTERS && (cfg->pointers < 1 || cfg->pointers > DIR_MAXPOINTERS))
+  {
+     fprintf(stderr, "a directory entry holds 1 to %d pointers\n", DIR_MAXPOINTERS);
+     return -1;
+  }
+  d->sets = (entries + cfg->ways - 1) / cfg->ways;
+  if (d->sets > 0xffffffffu)
+  {
+     fprintf(stderr, "too many directory entries\n");
+     return -1;
+  }
+  d->config.entries = d->sets * cfg->ways;
+  makeDivider(&d->setDiv, d->sets);
+  d->set = calloc(d->sets, sizeof (dirSet));
+  d->entry = calloc((size_t) d->sets * cfg->ways, sizeof (dirEntry));
+  if (d->set == NULL || d->entry == NULL)
+  {
+     fprintf(stderr, "cannot allocate %u directory entries\n", d->config.entries);
+     dirFree(d);
+     return -1;
+  }
+  d->allCores = cores == 64 ? ~0ull : (1ull << cores) - 1;
+  // every set starts out of date, and is emptied on first use
+  d->epoch = 1;
+  return 0;
+}
+
+void dirFree(directory *d)
+{
+  free(d->set);
+  free(d->entry);
+  memset(d, 0, sizeof (directory));
+}
+
+// forget every entry; as with the caches, only a new epoch is started
+void dirReset(directory *d)
+{
+  d->epoch++;
+  if (d->epoch == 0)
+  {
+     memset(d->set, 0, d->sets * sizeof (dirSet));
+     d->epoch = 1;
+  }
+}
+
+// a new entry for a block, owned by no core and with no sharers, taking a
+// free way of its set or else the least recently used one; an entry that
+// had to be evicted is copied to *victim and *evicted set, and the caller
+// recalls its copies
+dirEntry *dirAllocate(directory *d, uint32_t block, dirEntry *victim, int *evicted)
+{
+  uint32_t index = dirIndex(d, block);
+  dirSet *s = &d->set[index];
+  uint32_t empty = ~s->valid & ((1u << d->config.ways) - 1);
+  dirEntry *e;
+  int way;
+
+  *evicted = 0;
+  if (empty)
+     way = __builtin_ctz(empty);
+  else
+  {
+     way = replVictim(REPL_LRU, &s->repl, d->config.ways);
+     *victim = d->entry[(size_t) index * d->config.ways + way];
+     *evicted = 1;
+     d->stats.evictions++;
+  }
+  s->valid |= 1u << way;
+  replFill(REPL_LRU, &s->repl, way, d->config.ways, index, NULL);
+  e = &d->entry[(size_t) index * d->config.ways + way];
+  e->block = block;
+  e->owner = DIR_NONE;
+  e->count = 0;
+  e->sharers = 0;
+  return e;
+}
+
+// free an entry no core has a copy for
+void dirRelease(directory *d, dirEntry *e)
+{
+  size_t slot = e - d->entry;
+  d->set[slot / d->config.ways].valid &= ~(1u << (slot % d->config.ways));
+}
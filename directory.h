@@ -0,0 +1,250 @@
+/* directory.h
+ *
+ * A sparse directory for the cores of coherence.h, in place of the
+ * snooping bus.
+ *
+ * Every line held by any core has an entry in a set-associative directory
+ * of a fixed number of entries, found by the line's block number. A core's
+ * miss or upgrade is sent to the directory, which forwards it to the owner
+ * of an E or M line or invalidates the sharers it records, so only those
+ * cores see the request. When a set of the directory is full the least
+ * recently used entry is evicted and every copy it tracked is recalled.
+ * Cores tell the directory when they evict a line, writing it back if it
+ * was modified.
+ *
+ * The sharers of an entry are recorded in one of three ways:
+ *
+ *   full      a bit per core
+ *   coarse    a bit per group of 'group' cores, every core of a group
+ *             is invalidated when any of them shares the line
+ *   pointers  up to 'pointers' core ids; one more sharer and the entry
+ *             falls back to invalidating every core
+ *
+ * Only the full vector is exact. The others send some invalidations to
+ * cores without a copy, and their entries may outlive the copies.
+ *
+ */
+
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+
+#include <stdint.h>
+
+#include "cache.h"
+
+#define DIR_FULL 0
+#define DIR_COARSE 1
+#define DIR_POINTERS 2
+
+// owner of an entry no core owns; count of a pointer entry that overflowed
+#define DIR_NONE 0xff
+#define DIR_OVERFLOW 0xff
+
+// pointers are kept a byte each in the sharers word
+#define DIR_MAXPOINTERS 8
+
+typedef struct
+{
+  unsigned entries;    // 0 for as many as the cores have lines
+  unsigned ways;       // 1 to MAXWAYS
+  int sharers;         // DIR_*
+  unsigned group;      // cores per bit of a coarse vector
+  unsigned pointers;   // core ids an entry holds before it overflows
+} dirConfig;
+
+// messages between the cores and the directory, and its own events
+typedef struct
+{
+  long long requests;       // GetS, GetM and upgrades
+  long long forwards;       // requests forwarded to an owner
+  long long data;           // replies carrying a line
+  long long invalidations;  // invalidations sent
+  long long acks;           // their acknowledgements, and upgrade grants
+  long long writebacks;     // modified lines sent back
+  long long hints;          // clean evictions reported
+  long long evictions;      // entries evicted to make room
+  long long recalls;        // copies invalidated by those evictions
+  long long spurious;       // invalidations of cores without a copy
+} dirStats;
+
+// one tracked line: its owner when it is E or M at one core, otherwise its
+// sharers as the representation records them
+typedef struct
+{
+  uint32_t block;
+  uint8_t owner;
+  uint8_t count;       // pointers in use, or DIR_OVERFLOW
+  uint16_t pad;
+  uint64_t sharers;
+} dirEntry;
+
+// valid has a bit per way holding an entry; epoch is as in cacheSet
+typedef struct
+{
+  uint64_t repl;
+  uint32_t valid;
+  uint32_t epoch;
+} dirSet;
+
+typedef struct
+{
+  dirConfig config;
+  unsigned sets;
+  divider setDiv;
+  dirSet *set;
+  dirEntry *entry;     // sets * ways, set by set
+  uint32_t epoch;
+  uint64_t allCores;
+  dirStats stats;
+} directory;
+
+void dirDefaults(dirConfig *cfg);
+int dirConfigSpec(dirConfig *cfg, const char *spec);
+int dirCreate(directory *d, const dirConfig *cfg, const cacheConfig *cacheCfg, int cores);
+void dirFree(directory *d);
+void dirReset(directory *d);
+dirEntry *dirAllocate(directory *d, uint32_t block, dirEntry *victim, int *evicted);
+void dirRelease(directory *d, dirEntry *e);
+const char *dirName(int sharers);
+
+// the set a block's entry is in, brought up to date after a reset
+static inline uint32_t dirIndex(directory *d, uint32_t block)
+{
+  uint32_t index = block - divide(&d->setDiv, block) * d->sets;
+  dirSet *s = &d->set[index];
+  if (s->epoch != d->epoch)
+  {
+     s->valid = 0;
+     s->repl = replInit(REPL_LRU, index);
+     s->epoch = d->epoch;
+  }
+  return index;
+}
+
+// the entry of a block, or NULL if it has none
+static inline dirEntry *dirFind(directory *d, uint32_t block)
+{
+  uint32_t index = dirIndex(d, block);
+  dirEntry *e = &d->entry[(size_t) index * d->config.ways];
+  uint32_t valid;
+
+  for (valid = d->set[index].valid; valid != 0; valid &= valid - 1)
+  {
+     if (e[__builtin_ctz(valid)].block == block)
+        return &e[__builtin_ctz(valid)];
+  }
+  return NULL;
+}
+
+// a request used the entry, it becomes the most recently used of its set
+static inline void dirTouch(directory *d, const dirEntry *e)
+{
+  size_t slot = e - d->entry;
+  replHit(REPL_LRU, &d->set[slot / d->config.ways].repl, slot % d->config.ways,
+          d->config.ways);
+}
+
+// the cores a request for the entry's line has to reach
+static inline uint64_t dirTargets(const directory *d, const dirEntry *e)
+{
+  uint64_t mask = 0, bits;
+  unsigned i;
+
+  if (e->owner != DIR_NONE)
+     return 1ull << e->owner;
+  switch (d->config.sharers)
+  {
+    case DIR_COARSE:
+      for (bits = e->sharers; bits != 0; bits &= bits - 1)
+         mask |= (d->config.group == 64 ? ~0ull : (1ull << d->config.group) - 1)
+                 << (__builtin_ctzll(bits) * d->config.group);
+      return mask & d->allCores;
+    case DIR_POINTERS:
+      if (e->count == DIR_OVERFLOW)
+         return d->allCores;
+      for (i = 0; i < e->count; i++)
+         mask |= 1ull << ((e->sharers >> (8 * i)) & 0xff);
+      return mask;
+  }
+  return e->sharers;
+}
+
+static inline void dirSetOwner(dirEntry *e, int core)
+{
+  e->owner = core;
+  e->sharers = 0;
+  e->count = 0;
+}
+
+static inline void dirAddSharer(const directory *d, dirEntry *e, int core)
+{
+  unsigned i;
+
+  switch (d->config.sharers)
+  {
+    case DIR_FULL:
+      e->sharers |= 1ull << core;
+      break;
+    case DIR_COARSE:
+      e->sharers |= 1ull << (core / d->config.group);
+      break;
+    case DIR_POINTERS:
+      if (e->count == DIR_OVERFLOW)
+         break;
+      for (i = 0; i < e->count; i++)
+      {
+         if (((e->sharers >> (8 * i)) & 0xff) == (unsigned) core)
+            return;
+      }
+      if (e->count == d->config.pointers)
+         e->count = DIR_OVERFLOW;
+      else
+      {
+         e->sharers |= (uint64_t) core << (8 * e->count);
+         e->count++;
+      }
+      break;
+  }
+}
+
+// a core no longer has the line; only the exact representations can
+// forget it, and the entry is released once they know of no copy
+static inline void dirRemoveSharer(directory *d, dirEntry *e, int core)
+{
+  unsigned i;
+
+  if (e->owner == core)
+     e->owner = DIR_NONE;
+  else
+  {
+     switch (d->config.sharers)
+     {
+       case DIR_FULL:
+         e->sharers &= ~(1ull << core);
+         break;
+       case DIR_POINTERS:
+         if (e->count == DIR_OVERFLOW)
+            return;
+         for (i = 0; i < e->count; i++)
+         {
+            if (((e->sharers >> (8 * i)) & 0xff) == (unsigned) core)
+            {
+               // the last pointer takes its place
+               uint64_t last = (e->sharers >> (8 * (e->count - 1))) & 0xff;
+               e->sharers &= ~(0xffull << (8 * i));
+               e->sharers |= last << (8 * i);
+               e->sharers &= ~(0xffull << (8 * (e->count - 1)));
+               e->count--;
+               break;
+            }
+         }
+         break;
+       default:
+         return;
+     }
+  }
+  if (e->owner == DIR_NONE && e->sharers == 0 && e->count == 0)
+     dirRelease(d, e);
+}
+
+#endif
@@ -0,0 +1,275 @@
+/* dram.c
+ *
+ * Timing reads and writebacks against the DRAM banks and the writeback
+ * buffer, see dram.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "dram.h"
+
+// two channels of DDR4-3200 behind a 3GHz core: 14ns for each of cas,
+// rcd and rp, and a 64-byte line in 2.5ns
+void dramDefaults(dramConfig *cfg)
+{
+  cfg->channels = 2;
+  cfg->banks = 16;
+  cfg->rowSize = 8192;
+  cfg->cas = 42;
+  cfg->rcd = 42;
+  cfg->rp = 42;
+  cfg->burst = 8;
+  cfg->buffer = 16;
+  cfg->mhz = 3000;
+}
+
+// apply a comma separated list of key=value settings, e.g.
+// "channels=4,banks=8,row=2K,buffer=32"
+int dramConfigSpec(dramConfig *cfg, const char *spec)
+{
+  char buf[256];
+  char *item, *value, *save;
+  int err;
+
+  if (strlen(spec) >= sizeof (buf))
+     return -1;
+  strcpy(buf, spec);
+  for (item = strtok_r(buf, ",", &save); item != NULL;
+       item = strtok_r(NULL, ",", &save))
+  {
+     value = strchr(item, '=');
+     if (value == NULL)
+        return -1;
+     *value++ = '\0';
+     if (strcmp(item, "channels") == 0)
+        err = parseCount(value, &cfg->channels);
+     else if (strcmp(item, "banks") == 0)
+        err = parseCount(value, &cfg->banks);
+     else if (strcmp(item, "row") == 0)
+        err = parseCount(value, &cfg->rowSize);
+     else if (strcmp(item, "cas") == 0)
+        err = parseCount(value, &cfg->cas);
+     else if (strcmp(item, "rcd") == 0)
+        err = parseCount(value, &cfg->rcd);
+     else if (strcmp(item, "rp") == 0)
+        err = parseCount(value, &cfg->rp);
+     else if (strcmp(item, "burst") == 0)
+        err = parseCount(value, &cfg->burst);
+     else if (strcmp(item, "buffer") == 0)
+        err = parseCount(value, &cfg->buffer);
+     else if (strcmp(item, "mhz") == 0)
+        err = parseCount(value, &cfg->mhz);
+     else
+        err = -1;
+     if (err != 0)
+        return -1;
+  }
+  return 0;
+}
+
+// returns -1, after saying why, if the memory cannot be built
+int dramCreate(dram *d, const dramConfig *cfg, unsigned lineSize)
+{
+  memset(d, 0, sizeof (dram));
+  d->config = *cfg;
+  d->lineSize = lineSize;
+  if (cfg->rowSize < lineSize || cfg->rowSize % lineSize != 0)
+  {
+     fprintf(stderr, "a DRAM row must be a whole number of %u-byte lines\n", lineSize);
+     return -1;
+  }
+  d->rowLines = cfg->rowSize / lineSize;
+  d->bank = calloc((size_t) cfg->channels * cfg->banks, sizeof (dramBank));
+  d->channelFree = calloc(cfg->channels, sizeof (long long));
+  d->queue = calloc(cfg->buffer, sizeof (dramWrite));
+  if (d->bank == NULL || d->channelFree == NULL || d->queue == NULL)
+  {
+     fprintf(stderr, "cannot allocate the DRAM model\n");
+     dramFree(d);
+     return -1;
+  }
+  return 0;
+}
+
+void dramFree(dram *d)
+{
+  free(d->bank);
+  free(d->channelFree);
+  free(d->queue);
+  memset(d, 0, sizeof (dram));
+}
+
+// the channel, bank and row a line is in
+static inline dramBank *locate(dram *d, uint32_t block, unsigned *channel,
+                               uint32_t *row)
+{
+  uint32_t rows = block / d->rowLines;
+  unsigned bank;
+
+  *channel = rows % d->config.channels;
+  rows /= d->config.channels;
+  bank = rows % d->config.banks;
+  *row = rows / d->config.banks;
+  return &d->bank[*channel * d->config.banks + bank];
+}
+
+// when an access to a line started no earlier than start would be done
+static long long finish(dram *d, uint32_t block, long long start)
+{
+  unsigned channel;
+  uint32_t row;
+  dramBank *b = locate(d, block, &channel, &row);
+
+  if (start < b->free)
+     start = b->free;
+  if (!b->open)
+     start += d->config.rcd + d->config.cas;
+  else if (b->row != row)
+     start += d->config.rp + d->config.rcd + d->config.cas;
+  else
+     start += d->config.cas;
+  if (start < d->channelFree[channel])
+     start = d->channelFree[channel];
+  return start + d->config.burst;
+}
+
+// carry out an access finishing at done, leaving its row open
+static void commit(dram *d, uint32_t block, long long done)
+{
+  unsigned channel;
+  uint32_t row;
+  dramBank *b = locate(d, block, &channel, &row);
+
+  if (!b->open)
+     d->stats.rowEmpty++;
+  else if (b->row != row)
+     d->stats.rowConflicts++;
+  else
+     d->stats.rowHits++;
+  b->open = 1;
+  b->row = row;
+  b->free = done;
+  d->channelFree[channel] = done;
+}
+
+static void dequeue(dram *d, unsigned i)
+{
+  memmove(&d->queue[i], &d->queue[i + 1], (d->queued - i - 1) * sizeof (dramWrite));
+  d->queued--;
+}
+
+// send the queued writes that their bank and channel had time for before now
+static void drain(dram *d, long long now)
+{
+  unsigned i = 0;
+  long long done;
+
+  while (i < d->queued)
+  {
+     done = finish(d, d->queue[i].block, d->queue[i].time);
+     if (done > now)
+     {
+        i++;
+        continue;
+     }
+     commit(d, d->queue[i].block, done);
+     d->stats.writes++;
+     dequeue(d, i);
+  }
+}
+
+static int queuedAt(const dram *d, uint32_t block)
+{
+  unsigned i;
+  for (i = 0; i < d->queued; i++)
+  {
+     if (d->queue[i].block == block)
+        return i;
+  }
+  return -1;
+}
+
+// a line is read at the given time; returns how long it takes
+long long dramRead(dram *d, uint32_t addr, long long now)
+{
+  uint32_t block = addr / d->lineSize;
+  long long done;
+
+  if (queuedAt(d, block) >= 0)
+  {
+     d->stats.forwarded++;
+     return 0;
+  }
+  drain(d, now);
+  done = finish(d, block, now);
+  commit(d, block, done);
+  d->stats.reads++;
+  d->stats.readCycles += done - now;
+  return done - now;
+}
+
+// a modified line is written back at the given time; returns how long the
+// processor waits for room in the buffer
+long long dramWriteback(dram *d, uint32_t addr, long long now)
+{
+  uint32_t block = addr / d->lineSize;
+  long long stall = 0, done;
+
+  if (queuedAt(d, block) >= 0)
+  {
+     d->stats.merged++;
+     return 0;
+  }
+  drain(d, now);
+  if (d->queued == d->config.buffer)
+  {
+     done = finish(d, d->queue[0].block, now);
+     commit(d, d->queue[0].block, done);
+     d->stats.writes++;
+     d->stats.full++;
+     dequeue(d, 0);
+     stall = done - now;
+     d->stats.stallCycles += stall;
+  }
+  d->queue[d->queued].block = block;
+  d->queue[d->queued].time = now + stall;
+  d->queued++;
+  return stall;
+}
+
+// the run is over: whatever is still queued is written
+void dramFinish(dram *d, long long now)
+{
+  while (d->queued > 0)
+  {
+     commit(d, d->queue[0].block, finish(d, d->queue[0].block, now));
+     d->stats.writes++;
+     dequeue(d, 0);
+  }
+}
+
+// cycles is how long the run took, for the bandwidth
+void dramPrintStats(const dram *d, long long cycles)
+{
+  const dramStats *s = &d->stats;
+  long long bytes = (s->reads + s->writes) * d->lineSize;
+  double perCycle = cycles ? (double) bytes / cycles : 0;
+
+  printf(" DRAM: %u channels of %u banks, %u-byte rows, %u-entry writeback buffer\n"
+         " DRAM reads: %lld (average %.1f cycles)\n DRAM writes: %lld\n"
+         " Row hits: %lld\n Rows opened: %lld (%lld closing another)\n"
+         " Writebacks merged in the buffer: %lld\n Reads served from it: %lld\n"
+         " Buffer full: %lld times, %lld cycles waited\n"
+         " Memory traffic: %lld bytes read, %lld bytes written\n"
+         " Bandwidth: %.3f bytes per cycle, %.2f GB/s at %u MHz\n",
+         d->config.channels, d->config.banks, d->config.rowSize, d->config.buffer,
+         s->reads, s->reads ? (double) s->readCycles / s->reads : 0, s->writes,
+         s->rowHits, s->rowEmpty + s->rowConflicts, s->rowConflicts, s->merged,
+         s->forwarded, s->full, s->stallCycles, s->reads * d->lineSize,
+         s->writes * d->lineSize, perCycle, perCycle * d->config.mhz / 1000,
+         d->config.mhz);
+}
@@ -0,0 +1,92 @@
+/* dram.h
+ *
+ * The memory behind the last level of a cache hierarchy: a writeback
+ * buffer in front of DRAM channels of banks with open row buffers.
+ *
+ * Times are in core cycles. A line maps to a channel, bank and row with
+ * consecutive lines in the same row, then rows spread over the channels
+ * and then the banks, so a stream keeps its row open. A bank keeps the
+ * row of its last access open: an access to that row costs the column
+ * access (cas), to a closed bank the activate as well (rcd), and to
+ * another row a precharge first (rp). The line then takes 'burst' cycles
+ * on its channel. A bank or channel still busy with an earlier access
+ * delays the next one.
+ *
+ * Modified lines written back are queued in the buffer and cost the
+ * processor nothing while it has room. A write to a line already queued
+ * is merged with it, and a read of one is served from the buffer. Queued
+ * writes go to DRAM in the idle time of their bank and channel, whenever
+ * they would have been finished by the time of the next access. When the
+ * buffer is full, the oldest write is sent at once and the processor
+ * waits for it to finish.
+ *
+ */
+
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <stdint.h>
+
+typedef struct
+{
+  unsigned channels;
+  unsigned banks;      // per channel
+  unsigned rowSize;    // bytes in a bank's row
+  unsigned cas;        // cycles to read or write an open row
+  unsigned rcd;        // cycles to open a row
+  unsigned rp;         // cycles to close one
+  unsigned burst;      // cycles a line takes on its channel
+  unsigned buffer;     // writeback buffer entries
+  unsigned mhz;        // the core clock, to give bandwidth in GB/s
+} dramConfig;
+
+typedef struct
+{
+  long long reads;          // lines read from DRAM
+  long long writes;         // lines written to DRAM
+  long long rowHits;        // accesses to an open row
+  long long rowEmpty;       // to a bank with no row open
+  long long rowConflicts;   // to a bank with another row open
+  long long readCycles;     // the reads' latencies added up
+  long long merged;         // writebacks merged into a queued write
+  long long forwarded;      // reads served from the buffer
+  long long full;           // writebacks that found the buffer full
+  long long stallCycles;    // cycles the processor waited for room
+} dramStats;
+
+typedef struct
+{
+  uint32_t row;
+  int open;
+  long long free;      // when its last access is done
+} dramBank;
+
+// a queued write and when it was queued
+typedef struct
+{
+  uint32_t block;
+  long long time;
+} dramWrite;
+
+typedef struct
+{
+  dramConfig config;
+  unsigned lineSize;
+  unsigned rowLines;   // lines in a row
+  dramBank *bank;      // channels * banks, channel by channel
+  long long *channelFree;
+  dramWrite *queue;    // oldest first
+  unsigned queued;
+  dramStats stats;
+} dram;
+
+void dramDefaults(dramConfig *cfg);
+int dramConfigSpec(dramConfig *cfg, const char *spec);
+int dramCreate(dram *d, const dramConfig *cfg, unsigned lineSize);
+void dramFree(dram *d);
+long long dramRead(dram *d, uint32_t addr, long long now);
+long long dramWriteback(dram *d, uint32_t addr, long long now);
+void dramFinish(dram *d, long long now);
+void dramPrintStats(const dram *d, long long cycles);
+
+#endif
@@ -0,0 +1,558 @@
+/* hierarchy.c
+ *
+ * Moving lines between the levels of a cache hierarchy, see hierarchy.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hierarchy.h"
+
+static const char *const inclusionNames[] = { "inclusive", "exclusive", "nine" };
+static const char *const levelNames[] = { "L1I", "L1D", "L2", "L3" };
+static const char *const displayNames[] =
+{
+  "display-l1i.txt", "display-l1d.txt", "display.txt", "display-l3.txt"
+};
+
+// L1s of 32KB, 8 ways of 64-byte lines; no L3
+void hierDefaults(hierConfig *cfg)
+{
+  memset(cfg, 0, sizeof (hierConfig));
+  cfg->l1iSets = 64;
+  cfg->l1iWays = 8;
+  cfg->l1dSets = 64;
+  cfg->l1dWays = 8;
+  cfg->inclusion = INCL_INCLUSIVE;
+  cfg->latency[LEVEL_L1I] = 4;
+  cfg->latency[LEVEL_L1D] = 4;
+  cfg->latency[LEVEL_L2] = 14;
+  cfg->latency[LEVEL_L3] = 40;
+}
+
+// read a level's geometry written as setsxways, e.g. 64x8 or 16Kx16
+static int parseGeometry(char *value, unsigned *sets, unsigned *ways)
+{
+  char *x = strrchr(value, 'x');
+  if (x == NULL)
+     return -1;
+  *x = '\0';
+  return parseCount(value, sets) != 0 || parseCount(x + 1, ways) != 0 ? -1 : 0;
+}
+
+// apply a comma separated list of key=value settings, e.g.
+// "l1d=64x8,l3=16Kx16,inclusion=nine"
+int hierConfigSpec(hierConfig *cfg, const char *spec)
+{
+  char buf[256];
+  char *item, *value, *save;
+  int i, err;
+
+  if (strlen(spec) >= sizeof (buf))
+     return -1;
+  strcpy(buf, spec);
+  for (item = strtok_r(buf, ",", &save); item != NULL;
+       item = strtok_r(NULL, ",", &save))
+  {
+     value = strchr(item, '=');
+     if (value == NULL)
+        return -1;
+     *value++ = '\0';
+     if (strcmp(item, "l1i") == 0)
+        err = parseGeometry(value, &cfg->l1iSets, &cfg->l1iWays);
+     else if (strcmp(item, "l1d") == 0)
+        err = parseGeometry(value, &cfg->l1dSets, &cfg->l1dWays);
+     else if (strcmp(item, "l3") == 0)
+     {
+        err = 0;
+        if (strcmp(value, "none") == 0)
+           cfg->l3Sets = cfg->l3Ways = 0;
+        else
+           err = parseGeometry(value, &cfg->l3Sets, &cfg->l3Ways);
+     }
+     else if (strcmp(item, "inclusion") == 0)
+     {
+        err = -1;
+        for (i = 0; i < INCL_POLICIES; i++)
+        {
+           if (strcmp(value, inclusionNames[i]) == 0)
+           {
+              cfg->inclusion = i;
+              err = 0;
+           }
+        }
+     }
+     else if (strcmp(item, "l1lat") == 0)
+     {
+        err = parseCount(value, &cfg->latency[LEVEL_L1I]);
+        cfg->latency[LEVEL_L1D] = cfg->latency[LEVEL_L1I];
+     }
+     else if (strcmp(item, "l2lat") == 0)
+        err = parseCount(value, &cfg->latency[LEVEL_L2]);
+     else if (strcmp(item, "l3lat") == 0)
+        err = parseCount(value, &cfg->latency[LEVEL_L3]);
+     else if (strcmp(item, "stream") == 0)
+     {
+        strcpy(cfg->stream, value);
+        err = 0;
+     }
+     else
+        err = -1;
+     if (err != 0)
+        return -1;
+  }
+  return 0;
+}
+
+// the L2's requests as a trace: lines asked for by the L1s as reads (0)
+// or instruction fetches (2), and modified victims as writes (1)
+
+static int streamFlush(hierarchy *h)
+{
+  if (fwrite(h->streamBuf, sizeof (traceRecord), h->streamLen, h->stream) != h->streamLen)
+     return -1;
+  h->streamHeader.count += h->streamLen;
+  h->streamLen = 0;
+  return 0;
+}
+
+static inline void streamAppend(hierarchy *h, int n, uint32_t addr)
+{
+  if (h->stream == NULL)
+     return;
+  h->streamBuf[h->streamLen++] = (traceRecord) { .addr = addr, .n = n };
+  // a failed write is reported when the stream is closed
+  if (h->streamLen == TRACE_BLOCK && streamFlush(h) != 0)
+     h->streamLen = 0;
+}
+
+// write what is left and the final count; returns -1 if any write failed
+static int streamClose(hierarchy *h)
+{
+  int err = streamFlush(h) != 0 || ferror(h->stream);
+
+  fseek(h->stream, 0, SEEK_SET);
+  fwrite(&h->streamHeader, sizeof (traceHeader), 1, h->stream);
+  err |= fclose(h->stream) != 0;
+  h->stream = NULL;
+  if (err)
+     fprintf(stderr, "%s: write failed\n", h->config.stream);
+  return err ? -1 : 0;
+}
+
+// the level a level's misses and victims go to, h->levels being memory
+static inline int below(int k)
+{
+  return k < LEVEL_L2 ? LEVEL_L2 : k + 1;
+}
+
+static void writeback(const int policy, const int inclusion, hierarchy *h, int k,
+                      uint32_t addr, int MESI);
+
+// the copies of a victim of level k in the levels above it are
+// invalidated, those above them first; returns the victim's state, M if
+// any copy was modified
+static int backInvalidate(hierarchy *h, int k, uint32_t addr, int MESI)
+{
+  uint32_t index, tag;
+  int j, way, held;
+
+  for (j = k == LEVEL_L2 ? LEVEL_L1I : k - 1; j < k; j++)
+  {
+     held = findLine(&h->level[j], addr, &index, &tag, &way);
+     if (held == I)
+        continue;
+     if (j >= LEVEL_L2)
+        held = backInvalidate(h, j, addr, held);
+     setMESI(&h->level[j], index, way, I);
+     h->stats.backInvalidations++;
+     if (held == M)
+     {
+        h->stats.backModified++;
+        MESI = M;
+     }
+  }
+  return MESI;
+}
+
+// an exclusive L1 that misses asks the other L1 first, through the L2
+// that sits between them: the line moves across with its state rather
+// than being fetched from below, so the two never both hold it; returns
+// the state it arrived in, I if the other L1 did not hold it
+static int takeAcross(hierarchy *h, int k, uint32_t addr)
+{
+  uint32_t index, tag;
+  int way, MESI;
+
+  MESI = findLine(&h->level[LEVEL_L1I + LEVEL_L1D - k], addr, &index, &tag, &way);
+  if (MESI == I)
+     return I;
+  setMESI(&h->level[LEVEL_L1I + LEVEL_L1D - k], index, way, I);
+  h->stats.crossTransfers++;
+  h->stall += h->config.latency[LEVEL_L2];
+  return MESI;
+}
+
+// pick the way of level k a missing line goes in: a way still holding the
+// tag is reused, then an invalid way, and only then does the policy choose
+// a victim, which is back-invalidated and written back as the inclusion
+// policy says
+static inline __attribute__((always_inline))
+int makeRoom(const int policy, const int inclusion, hierarchy *h, int k,
+             uint32_t index, int way)
+{
+  cache *c = &h->level[k];
+  uint32_t invalid, addr;
+  int MESI;
+
+  if (way < MAXWAYS)
+     return way;
+  invalid = ~validWays(c, index) & c->wayMask;
+  if (invalid)
+     return __builtin_ctz(invalid);
+
+  way = chooseVictim(policy, c, index, c->config.ways);
+  addr = c->address[index * c->config.ways + way];
+  MESI = getMESI(c, index, way);
+  // gone before it is passed down, so nothing below finds it here
+  setMESI(c, index, way, I);
+  if (inclusion == INCL_INCLUSIVE && k >= LEVEL_L2)
+     MESI = backInvalidate(h, k, addr, MESI);
+  if (inclusion == INCL_EXCLUSIVE || MESI == M)
+     writeback(policy, inclusion, h, below(k), addr, MESI);
+  return way;
+}
+
+// a victim of the level above arrives at level k: a copy already there
+// takes its data, otherwise an exclusive level is filled with it and the
+// others pass a modified one further down
+static void writeback(const int policy, const int inclusion, hierarchy *h, int k,
+                      uint32_t addr, int MESI)
+{
+  cache *c;
+  uint32_t index, tag;
+  int way;
+
+  if (k == h->levels)
+  {
+     if (MESI == M)
+     {
+        h->stats.memWrites++;
+        h->stall += dramWriteback(&h->memory, addr, h->now + h->stall);
+     }
+     return;
+  }
+  if (k == LEVEL_L2 && MESI == M)
+     streamAppend(h, 1, addr);
+  c = &h->level[k];
+  c->stats.refCount++;
+  c->stats.writeCount++;
+  if (findLine(c, addr, &index, &tag, &way) != I)
+  {
+     c->stats.hitCount++;
+     touchWay(policy, c, index, way, c->config.ways);
+     if (MESI == M)
+        setMESI(c, index, way, M);
+     return;
+  }
+  c->stats.missCount++;
+  if (inclusion == INCL_EXCLUSIVE)
+  {
+     way = makeRoom(policy, inclusion, h, k, index, way);
+     installLine(policy, c, addr, index, tag, way, MESI);
+  }
+  else
+     writeback(policy, inclusion, h, below(k), addr, MESI);
+}
+
+// level k is asked for a line by the level above; returns the state the
+// copy above gets: an exclusive level gives up the line and its state,
+// the others keep it, modified or not, and give a clean copy
+// n is the op that missed in the L1
+static int fetch(const int policy, const int inclusion, hierarchy *h, int k, int n,
+                 uint32_t addr)
+{
+  cache *c;
+  uint32_t index, tag;
+  int way, MESI;
+
+  if (k == h->levels)
+  {
+     h->stats.memReads++;
+     h->stall += dramRead(&h->memory, addr, h->now + h->stall);
+     return E;
+  }
+  if (k == LEVEL_L2)
+     streamAppend(h, n == 2 ? 2 : 0, addr);
+  c = &h->level[k];
+  h->stall += h->config.latency[k];
+  c->stats.refCount++;
+  c->stats.readCount++;
+  MESI = findLine(c, addr, &index, &tag, &way);
+  if (MESI != I)
+  {
+     c->stats.hitCount++;
+     if (inclusion == INCL_EXCLUSIVE)
+     {
+        setMESI(c, index, way, I);
+        return MESI;
+     }
+     touchWay(policy, c, index, way, c->config.ways);
+     c->address[index * c->config.ways + way] = addr;
+     return MESI == S ? S : E;
+  }
+  c->stats.missCount++;
+  MESI = fetch(policy, inclusion, h, below(k), n, addr);
+  if (inclusion != INCL_EXCLUSIVE)
+  {
+     // the levels below may have back-invalidated ways of this set, so the
+     // way is chosen only now
+     way = makeRoom(policy, inclusion, h, k, index, way);
+     installLine(policy, c, addr, index, tag, way, MESI);
+  }
+  return MESI;
+}
+
+// carry out one reference of the trace
+// policy and inclusion are constants in every caller, so each kernel below
+// gets its own copy of this with both inlined; that covers the L1 hits,
+// nearly every reference, while fetch() and writeback() recurse and take
+// them as plain arguments
+static inline __attribute__((always_inline))
+void step(const int policy, const int inclusion, hierarchy *h, int n, uint32_t addr)
+{
+  cache *c;
+  uint32_t index, tag;
+  int k, way, MESI, dirty;
+
+  h->refCount++;
+  switch (n)
+  {
+    // n = 0 read data, n = 1 write data, n = 2 instruction fetch
+    case 0:
+    case 1:
+    case 2:
+      c = &h->level[n == 2 ? LEVEL_L1I : LEVEL_L1D];
+      h->stall = h->config.latency[LEVEL_L1D];
+      MESI = findLine(c, addr, &index, &tag, &way);
+      c->stats.refCount++;
+      if (n == 1)
+         c->stats.writeCount++;
+      else
+         c->stats.readCount++;
+      if (MESI != I)
+      {
+         c->stats.hitCount++;
+         touchWay(policy, c, index, way, c->config.ways);
+         if (n == 1 && MESI != M)
+            setMESI(c, index, way, M);
+         c->address[index * c->config.ways + way] = addr;
+         h->now += h->stall;
+         break;
+      }
+      c->stats.missCount++;
+      MESI = I;
+      if (inclusion == INCL_EXCLUSIVE)
+         MESI = takeAcross(h, n == 2 ? LEVEL_L1I : LEVEL_L1D, addr);
+      if (MESI == I)
+         MESI = fetch(policy, inclusion, h, LEVEL_L2, n, addr);
+      way = makeRoom(policy, inclusion, h, n == 2 ? LEVEL_L1I : LEVEL_L1D, index, way);
+      installLine(policy, c, addr, index, tag, way, n == 1 ? M : MESI);
+      h->now += h->stall;
+      break;
+    // 3 invalidate, 4 read, 5 write and 6 read for ownership by some other
+    // agent: every level drops its copy, or keeps it shared for a read,
+    // and a modified one is flushed
+    case 3:
+    case 4:
+    case 5:
+    case 6:
+      h->stats.external++;
+      dirty = 0;
+      for (k = 0; k < h->levels; k++)
+      {
+         c = &h->level[k];
+         MESI = findLine(c, addr, &index, &tag, &way);
+         if (MESI == I)
+            continue;
+         dirty |= MESI == M;
+         if (n != 4)
+            setMESI(c, index, way, I);
+         else if (MESI != S)
+            setMESI(c, index, way, S);
+      }
+      h->stats.flushes += dirty;
+      break;
+    // 8 clear every level
+    case 8:
+      for (k = 0; k < h->levels; k++)
+      {
+         fprintf(h->level[k].ofp, "Reference %lld called for the cache to be reset. "
+                 "No ways are valid.\n"
+                 "---------------------------------------------------------------------\n",
+                 h->refCount);
+         fflush(h->level[k].ofp);
+         cacheReset(&h->level[k]);
+      }
+      break;
+    // 9 print every level but change nothing
+    case 9:
+      for (k = 0; k < h->levels; k++)
+      {
+         fprintf(h->level[k].ofp, "Reference %lld displayed only indices containing "
+                 "valid ways.\n", h->refCount);
+         cacheDisplay(&h->level[k]);
+      }
+      break;
+  }
+}
+
+#define KERNEL(name, policy, inclusion) \
+static void name(hierarchy *h, const traceRecord *block, size_t count) \
+{ \
+  size_t i; \
+  for (i = 0; i < count; i++) \
+    step(policy, inclusion, h, block[i].n, block[i].addr); \
+}
+
+#define KERNELS(name, policy) \
+KERNEL(name##Inclusive, policy, INCL_INCLUSIVE) \
+KERNEL(name##Exclusive, policy, INCL_EXCLUSIVE) \
+KERNEL(name##NINE, policy, INCL_NINE)
+
+KERNELS(runLRU, REPL_LRU)
+KERNELS(runPLRU, REPL_PLRU)
+KERNELS(runSRRIP, REPL_SRRIP)
+KERNELS(runBRRIP, REPL_BRRIP)
+KERNELS(runDRRIP, REPL_DRRIP)
+KERNELS(runFIFO, REPL_FIFO)
+KERNELS(runRandom, REPL_RANDOM)
+
+#define POLICIES(suffix) \
+  { runLRU##suffix, runPLRU##suffix, runSRRIP##suffix, runBRRIP##suffix, \
+    runDRRIP##suffix, runFIFO##suffix, runRandom##suffix }
+
+// indexed by INCL_* and REPL_* from replace.h
+static const hierarchyKernel kernels[INCL_POLICIES][REPL_POLICIES] =
+{
+  POLICIES(Inclusive), POLICIES(Exclusive), POLICIES(NINE)
+};
+
+// create the levels hcfg describes around an L2 described by cfg, in
+// front of the memory dcfg describes; the other levels take the L2's line
+// size, address bits and policy
+// returns -1, after saying why, if it cannot
+int hierarchyCreate(hierarchy *h, const hierConfig *hcfg, const cacheConfig *cfg,
+                    const dramConfig *dcfg)
+{
+  cacheConfig level[LEVELS];
+  int k;
+
+  memset(h, 0, sizeof (hierarchy));
+  h->config = *hcfg;
+  for (k = 0; k < LEVELS; k++)
+     level[k] = *cfg;
+  level[LEVEL_L1I].sets = hcfg->l1iSets;
+  level[LEVEL_L1I].ways = hcfg->l1iWays;
+  level[LEVEL_L1D].sets = hcfg->l1dSets;
+  level[LEVEL_L1D].ways = hcfg->l1dWays;
+  level[LEVEL_L3].sets = hcfg->l3Sets;
+  level[LEVEL_L3].ways = hcfg->l3Ways;
+  h->levels = hcfg->l3Sets ? LEVELS : LEVEL_L3;
+
+  for (k = 0; k < h->levels; k++)
+  {
+     if (cacheCreate(&h->level[k], &level[k], displayNames[k]) != 0)
+     {
+        fprintf(stderr, "cannot create the %s\n", levelNames[k]);
+        hierarchyFree(h);
+        return -1;
+     }
+  }
+
+  if (dramCreate(&h->memory, dcfg, cfg->lineSize) != 0)
+  {
+     hierarchyFree(h);
+     return -1;
+  }
+
+  if (hcfg->stream[0] != '\0')
+  {
+     h->streamBuf = malloc(TRACE_BLOCK * sizeof (traceRecord));
+     h->stream = fopen(hcfg->stream, "wb");
+     if (h->streamBuf == NULL || h->stream == NULL)
+     {
+        fprintf(stderr, "%s: cannot create\n", hcfg->stream);
+        hierarchyFree(h);
+        return -1;
+     }
+     // the header is written again with the count when the run ends
+     memcpy(h->streamHeader.magic, TRACE_MAGIC, 4);
+     h->streamHeader.version = TRACE_VERSION;
+     fwrite(&h->streamHeader, sizeof (traceHeader), 1, h->stream);
+  }
+  h->run = kernels[hcfg->inclusion][cfg->policy];
+  return 0;
+}
+
+void hierarchyFree(hierarchy *h)
+{
+  int k;
+  for (k = 0; k < LEVELS; k++)
+     cacheFree(&h->level[k]);
+  dramFree(&h->memory);
+  if (h->stream != NULL)
+     fclose(h->stream);
+  free(h->streamBuf);
+  memset(h, 0, sizeof (hierarchy));
+}
+
+// run the rest of the trace, then write out what the writeback buffer
+// still holds and finish writing the L2's requests
+int hierarchyRun(hierarchy *h, trace *t)
+{
+  const traceRecord *block;
+  size_t count;
+
+  while ((count = traceNext(t, &block)) > 0)
+     h->run(h, block, count);
+  dramFinish(&h->memory, h->now);
+  if (h->stream != NULL && streamClose(h) != 0)
+     return -1;
+  return t->error ? -1 : 0;
+}
+
+void hierarchyPrintStats(const hierarchy *h)
+{
+  const hierStats *s = &h->stats;
+  long long demand;
+  int k;
+
+  printf("%5s ", "level");
+  cachePrintHeader();
+  for (k = 0; k < h->levels; k++)
+  {
+     printf("%5s ", levelNames[k]);
+     cachePrintRow(&h->level[k].config, &h->level[k].stats);
+  }
+  printf(" Total References: %lld\n Inclusion: %s\n Memory reads: %lld\n"
+         " Memory writes: %lld\n Back-invalidations: %lld (%lld modified)\n"
+         " Other agents' transactions: %lld\n Snoop flushes: %lld\n",
+         h->refCount, inclusionNames[h->config.inclusion], s->memReads, s->memWrites,
+         s->backInvalidations, s->backModified, s->external, s->flushes);
+  if (h->config.inclusion == INCL_EXCLUSIVE)
+     printf(" Lines moved between the L1s: %lld\n", s->crossTransfers);
+  demand = h->level[LEVEL_L1I].stats.refCount + h->level[LEVEL_L1D].stats.refCount;
+  printf(" Average memory access time: %.2f cycles (L1 %u, L2 %u",
+         demand ? (double) h->now / demand : 0, h->config.latency[LEVEL_L1D],
+         h->config.latency[LEVEL_L2]);
+  if (h->levels == LEVELS)
+     printf(", L3 %u", h->config.latency[LEVEL_L3]);
+  printf(")\n Cycles: %lld\n", h->now);
+  dramPrintStats(&h->memory, h->now);
+  if (h->config.stream[0] != '\0')
+     printf(" L2 requests written to %s\n", h->config.stream);
+  printf("---------------------------------------------------------------------\n");
+}
@@ -0,0 +1,126 @@
+/* hierarchy.h
+ *
+ * A hierarchy of caches between one processor and memory: split L1
+ * instruction and data caches, the L2 the usual options describe and,
+ * optionally, an L3.
+ *
+ * Instruction fetches (2) go to the L1I, reads (0) and writes (1) to the
+ * L1D. Every level is write-back and write-allocate, and a miss asks the
+ * level below for the line, down to memory. How the levels share lines is
+ * the inclusion policy, the same between every pair of levels:
+ *
+ *   inclusive  a line is filled into every level it passes on the way up;
+ *              a victim of the L2 or L3 is invalidated in every level
+ *              above it (back-invalidation), and a modified copy found
+ *              there makes the victim modified
+ *   exclusive  a line lives in one level only: it is filled into the L1
+ *              alone and leaves the level it was found in, and every
+ *              victim, clean or not, is filled into the level below; an
+ *              L1 miss looks in the other L1 before going below, and a
+ *              line found there moves across
+ *   nine       neither inclusive nor exclusive: lines are filled on the
+ *              way up as with inclusive, but victims leave the levels
+ *              above alone
+ *
+ * A modified victim is written back to the level below; one that level
+ * does not hold is passed further down (nine) or filled there (exclusive).
+ * Every level has the L2's line size and replacement policy, and runs on
+ * the same set code as a single cache.
+ *
+ * Each level counts the requests it sees: lines asked for from above as
+ * reads, writebacks from above as writes. The snooped ops (3, 4, 5, 6)
+ * are another agent's and reach every level, and 8 and 9 reset and
+ * display every level. The requests reaching the L2 can also be written
+ * as a binary trace, to run the other modes on what the L1s let through.
+ *
+ * Memory is the DRAM model of dram.h. The references are timed as if
+ * from a processor that waits for each one: a reference takes the lookup
+ * latency of every level it reaches, then DRAM's if it gets that far,
+ * and any wait for room in the writeback buffer. The average of these is
+ * the average memory access time.
+ *
+ */
+
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "trace.h"
+#include "cache.h"
+#include "dram.h"
+
+#define INCL_INCLUSIVE 0
+#define INCL_EXCLUSIVE 1
+#define INCL_NINE 2
+#define INCL_POLICIES 3
+
+// the caches of a hierarchy, from the top; there is no L3 when its
+// config has no sets
+#define LEVEL_L1I 0
+#define LEVEL_L1D 1
+#define LEVEL_L2 2
+#define LEVEL_L3 3
+#define LEVELS 4
+
+typedef struct
+{
+  unsigned l1iSets, l1iWays;
+  unsigned l1dSets, l1dWays;
+  unsigned l3Sets, l3Ways;
+  int inclusion;       // INCL_*
+  unsigned latency[LEVELS]; // cycles to look a line up at each level
+  char stream[256];    // where to write the L2's requests, "" for nowhere
+} hierConfig;
+
+typedef struct
+{
+  long long memReads;       // lines fetched from memory
+  long long memWrites;      // modified lines written to memory
+  long long backInvalidations; // copies invalidated above an inclusive victim
+  long long backModified;   // those that were modified
+  long long external;       // transactions of other agents, ops 3 to 6
+  long long flushes;        // modified lines those flushed
+  long long crossTransfers; // lines an exclusive L1 took from the other
+} hierStats;
+
+typedef struct hierarchy hierarchy;
+
+// runs a block of references through the hierarchy, see hierarchyRun()
+typedef void (*hierarchyKernel)(hierarchy *h, const traceRecord *block, size_t count);
+
+struct hierarchy
+{
+  hierConfig config;
+  cache level[LEVELS];
+  int levels;          // LEVEL_L3 without an L3, otherwise LEVELS
+
+  dram memory;
+
+  hierStats stats;
+  long long refCount;
+
+  // the cycles taken by the references so far, and by the one under way
+  long long now;
+  long long stall;
+
+  // the L2's requests, buffered a trace block at a time
+  FILE *stream;
+  traceRecord *streamBuf;
+  size_t streamLen;
+  traceHeader streamHeader;
+
+  // the loop for the replacement and inclusion policies
+  hierarchyKernel run;
+};
+
+void hierDefaults(hierConfig *cfg);
+int hierConfigSpec(hierConfig *cfg, const char *spec);
+int hierarchyCreate(hierarchy *h, const hierConfig *hcfg, const cacheConfig *cfg,
+                    const dramConfig *dcfg);
+void hierarchyFree(hierarchy *h);
+int hierarchyRun(hierarchy *h, trace *t);
+void hierarchyPrintStats(const hierarchy *h);
+
+#endif
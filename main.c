@@ -15,361 +15,689 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <string.h>
 
-// only change these lines when changing total size of the cache! 
-// LINES is the total number of lines (16384 for a 16K line cache)
-// WAYS is the total number of ways (columns) in that cache
-// MAXLINE and MAXWAY are LINES-- and WAYS-- respectively
+#include "trace.h"
+#include "cache.h"
+#include "stackdist.h"
+#include "parallel.h"
+#include "batch.h"
+#include "sample.h"
+#include "coherence.h"
+#include "hierarchy.h"
+#include "prefetch.h"
+#include "classify.h"
+#include "profile.h"
 
-#define LINES 16483
-#define WAYS 16
+// at most this many caches can be simulated in one pass with -c
+#define MAXCACHES 64
 
-#define MAXLINE 16482
-#define MAXWAY 5
+// with several caches, each runs a slice of a trace block this long before
+// the next cache takes the same slice, so the slice stays in the host's
+// L1/L2 while every cache reads it (32KB of records)
+#define SLICE 4096
 
-#define M 0
-#define E 1
-#define S 2 
-#define I 3
+// what a run does: simulate the caches the options describe, or one of
+// the modes below instead; only one mode can be chosen
+#define MODE_CACHES 0
+#define MODE_SAMPLE 1
+#define MODE_CORES 2
+#define MODE_HIERARCHY 3
+#define MODE_PREFETCH 4
+#define MODE_CLASSIFY 5
+#define MODE_CURVE 6
+#define MODE_BATCH 7
 
-typedef struct  
+// the options only some modes take
+#define TAKES_C 1            // more caches
+#define TAKES_J 2            // more than one thread
+#define TAKES_W 4
+#define TAKES_R 8
+#define TAKES_N 16
+#define TAKES_OPTIONS 5
+
+static const char *const takesNames[TAKES_OPTIONS] = { "-c", "-j", "-W", "-R", "-n" };
+
+// indexed by MODE_*: the option choosing the mode and the others it takes
+static const struct
 {
-  int MESIbits;
-  int LRUbits;
-  int tag;
-  int address;
-} cacheLine;
+  const char *option;
+  int takes;
+} modes[] =
+{
+  { "", TAKES_C | TAKES_J | TAKES_W | TAKES_R | TAKES_N },
+  { "-p", TAKES_R | TAKES_N },
+  { "-P", TAKES_N },
+  { "-H", TAKES_N },
+  { "-F", TAKES_N },
+  { "-C", TAKES_N },
+  { "-m", 0 },
+  { "-b", TAKES_C | TAKES_J },
+};
 
-// initialize a multi-dimensional array [row][col]
-// creates the single global cache
-cacheLine L2cache[LINES][WAYS];
+// run the trace through every cache
+// every cache runs a slice of a block before the next slice is touched
+// a single cache may instead be run on several threads
+// the first skip references are passed over and at most limit are run
+static int runCaches(const char *tracefile, cache *caches, int n, int threads,
+                     uint64_t skip, uint64_t limit)
+{
+  trace t;
+  const traceRecord *block;
+  size_t count, done, slice;
+  int i;
 
-FILE *ifp,*ofp;
+  // open the tracefile, make it available to 'r' read
+  if (traceOpen(&t, tracefile) != 0)
+  {
+    fprintf(stderr, "%s: cannot read trace\n", tracefile);
+    return 1;
+  }
+  if (traceSkip(&t, skip) != skip)
+  {
+    fprintf(stderr, "%s: fewer than %llu references to skip\n", tracefile,
+            (unsigned long long) skip);
+    return 1;
+  }
+  traceLimit(&t, limit);
 
-// step through the cache and set initial values
-// LRU bit will be the same value as the way
-// MESI bit begins invalid (empty)
-// Tag bits set to null because access decisions based on MESI
+  if (threads > 1)
+  {
+    if (parallelRun(&caches[0], &t, threads) != 0)
+      return 1;
+  }
 
-void setLRUbitsToWay()
-{
-  int index;
-  int way;
-  for (index = 0; index <= MAXLINE; index++)
+  // walk the trace a block at a time, binary blocks come straight from the map
+  while ((count = traceNext(&t, &block)) > 0)
   {
-    for (way = 0; way <= MAXWAY; way++)
+    for (done = 0; done < count; done += slice)
     {
-       L2cache[index][way].LRUbits = way;
-       L2cache[index][way].MESIbits = 3;
-       L2cache[index][way].tag = 0;
+      slice = count - done < SLICE ? count - done : SLICE;
+      for (i = 0; i < n; i++)
+        cacheRun(&caches[i], block + done, slice);
     }
+  } // end while loop
+  if (t.error)
+    return 1;
+  traceClose(&t);
+  return 0;
+}
+
+// run the trace through the part of the cache sc samples and print the
+// estimated stats
+static int runSample(const char *tracefile, cache *c, const sampleConfig *sc,
+                     uint64_t skip, uint64_t limit)
+{
+  sampleResult r;
+  trace t;
+
+  if (traceOpen(&t, tracefile) != 0)
+  {
+    fprintf(stderr, "%s: cannot read trace\n", tracefile);
+    return 1;
   }
+  if (traceSkip(&t, skip) != skip)
+  {
+    fprintf(stderr, "%s: fewer than %llu references to skip\n", tracefile,
+            (unsigned long long) skip);
+    return 1;
+  }
+  traceLimit(&t, limit);
+  if (sampleRun(c, &t, sc, &r) != 0 || t.error)
+    return 1;
+  traceClose(&t);
+  samplePrint(sc, &r);
+  sampleFree(&r);
+  return 0;
 }
 
-// check every way in the given index to see if the given tag exists
-// tag in each way of the appropriate index
-int checkTag(int index, int tag)
+// run the trace through cores private caches of cfg's geometry kept
+// coherent on a snooping bus, or by a directory if dcfg is not NULL, and
+// print the stats of each and of the protocol
+static int runCores(const char *tracefile, const cacheConfig *cfg, int cores,
+                    const dirConfig *dcfg, uint64_t limit)
 {
-  int way;
-  for (way = 0; way <= MAXWAY; way++)
+  coherence h;
+  trace t;
+  int err;
+
+  if (coherenceCreate(&h, cfg, cores, dcfg) != 0)
+    return 1;
+  if (traceOpen(&t, tracefile) != 0)
   {
-    if (L2cache[index][way].tag == tag)
-       return way;
-  } 
-  return WAYS;
+    fprintf(stderr, "%s: cannot read trace\n", tracefile);
+    coherenceFree(&h);
+    return 1;
+  }
+  traceLimit(&t, limit);
+  err = coherenceRun(&h, &t) != 0;
+  traceClose(&t);
+  if (!err)
+    coherencePrintStats(&h);
+  coherenceFree(&h);
+  return err;
 }
 
-// given an index, this function returns the least recently used way
-// LRU bits of 0 give the least recently used way
-// LRU bits of MAXWAY give most recently used way
-int checkLRU(int index)
+// run the trace through the L1s hcfg describes, the L2 cfg describes and
+// the L3 if there is one, in front of the memory mcfg describes, and print
+// the stats of every level and of the memory
+static int runHierarchy(const char *tracefile, const cacheConfig *cfg,
+                        const hierConfig *hcfg, const dramConfig *mcfg, uint64_t limit)
 {
-  int way;
-  for (way = 0; way <= MAXWAY; way++) 
+  hierarchy h;
+  trace t;
+  int err;
+
+  if (hierarchyCreate(&h, hcfg, cfg, mcfg) != 0)
+    return 1;
+  if (traceOpen(&t, tracefile) != 0)
   {
-    if (L2cache[index][way].LRUbits == 0)
-       return way;
+    fprintf(stderr, "%s: cannot read trace\n", tracefile);
+    hierarchyFree(&h);
+    return 1;
   }
-  return WAYS; 
+  traceLimit(&t, limit);
+  err = hierarchyRun(&h, &t) != 0;
+  traceClose(&t);
+  if (!err)
+    hierarchyPrintStats(&h);
+  hierarchyFree(&h);
+  return err;
 }
 
-// this function updates the LRU bits to reflect a new most recently used way
-void updateLRU(int index, int ourway)
+// run the trace through a single cache with prefetchers in front of it
+static int runPrefetch(const char *tracefile, const cacheConfig *cfg,
+                       const prefetchConfig *fcfg, uint64_t limit)
 {
-  // if the LRU bits of our way are already the most recently used, we do nothing
-  if (L2cache[index][ourway].LRUbits == MAXWAY)
-     return;
-  else 
-  {
-     int ourbits = L2cache[index][ourway].LRUbits;
-     int testbits = ourbits++;
-     int testway;
-     for (testbits = 0; testbits <= MAXWAY; testbits++)
-     {
-         testway = 0;
-         while (testway <= MAXWAY)
-         {
-            if (testbits == L2cache[index][testway].LRUbits)
-               {
-                  L2cache[index][testway].LRUbits--;
-                  break;
-               }
-            else 
-               testway++;
-	 }  
-     }
-     L2cache[index][ourway].LRUbits = MAXWAY;
+  cache c;
+  prefetcher p;
+  trace t;
+  int err;
+
+  if (cacheCreate(&c, cfg, "display.txt") != 0)
+    return 1;
+  if (prefetchCreate(&p, fcfg, &c) != 0)
+  {
+    cacheFree(&c);
+    return 1;
+  }
+  if (traceOpen(&t, tracefile) != 0)
+  {
+    fprintf(stderr, "%s: cannot read trace\n", tracefile);
+    prefetchFree(&p);
+    cacheFree(&c);
+    return 1;
   }
+  traceLimit(&t, limit);
+  err = prefetchRun(&p, &t) != 0;
+  traceClose(&t);
+  if (!err)
+  {
+    cachePrintStats(&c);
+    prefetchPrintStats(&p);
+  }
+  prefetchFree(&p);
+  cacheFree(&c);
+  return err;
 }
 
-// This function takes in an index and tests all ways within that index,
-// returning a 0 if it finds any valid way and a 1 if it does not.
+// run the trace through a single cache and sort its misses into kinds
+static int runClassify(const char *tracefile, const cacheConfig *cfg, uint64_t limit)
+{
+  cache c;
+  classifier k;
+  trace t;
+  int err;
 
-int testIndex(int index, int way)
+  if (cacheCreate(&c, cfg, "display.txt") != 0)
+    return 1;
+  if (classifyCreate(&k, &c) != 0)
+  {
+    cacheFree(&c);
+    return 1;
+  }
+  if (traceOpen(&t, tracefile) != 0)
+  {
+    fprintf(stderr, "%s: cannot read trace\n", tracefile);
+    classifyFree(&k);
+    cacheFree(&c);
+    return 1;
+  }
+  traceLimit(&t, limit);
+  err = classifyRun(&k, &t) != 0;
+  traceClose(&t);
+  if (!err)
+  {
+    cachePrintStats(&c);
+    classifyPrintStats(&k);
+  }
+  classifyFree(&k);
+  cacheFree(&c);
+  return err;
+}
+
+// simulate a cache of every power-of-two number of sets up to cfg's and
+// every number of ways up to cfg's, the way -m does when stack distances
+// cannot be used
+static int simulateCurve(const char *tracefile, const cacheConfig *cfg)
 {
-   for (way = 0; way <= MAXWAY; way++)
-   {
-       if (L2cache[index][way].MESIbits != I)
-       {
-          return 0;
-       }
-   }
-   return 1;
+  int levels = __builtin_ctz(cfg->sets) + 1;
+  int n = levels * cfg->ways;
+  cache *caches;
+  cacheConfig point = *cfg;
+  int i, err = 0;
+
+  if (cfg->ways > MAXWAYS)
+  {
+    fprintf(stderr, "ways must be 1 to %d to simulate every size\n", MAXWAYS);
+    return 1;
+  }
+  caches = calloc(n, sizeof (cache));
+  if (caches == NULL)
+  {
+    fprintf(stderr, "cannot allocate %d caches\n", n);
+    return 1;
+  }
+  for (i = 0; i < n && !err; i++)
+  {
+    point.sets = 1u << (i / cfg->ways);
+    point.ways = 1 + i % cfg->ways;
+    err = cacheCreate(&caches[i], &point, "/dev/null") != 0;
+  }
+  if (!err)
+    err = runCaches(tracefile, caches, n, 1, 0, UINT64_MAX);
+  if (!err)
+  {
+    cachePrintHeader();
+    for (i = 0; i < n; i++)
+      cachePrintRow(&caches[i].config, &caches[i].stats);
+  }
+  for (i = 0; i < n; i++)
+    cacheFree(&caches[i]);
+  free(caches);
+  return err;
 }
 
-// The cache displays all indices containing at least one way with a 
-// valid MESI bit
+// print the LRU hits and misses of every power-of-two number of sets up to
+// cfg's and every number of ways up to cfg's, from the stack distances of
+// one pass over the trace when its references allow it
+static int missCurve(const char *tracefile, const cacheConfig *cfg)
+{
+  stackDist sd;
+  cacheConfig point = *cfg;
+  cacheStats stats;
+  trace t;
+  const traceRecord *block;
+  size_t count;
+  unsigned level, ways;
+  int r = 0;
+
+  if (stackDistCreate(&sd, cfg) != 0)
+    return 1;
+  if (traceOpen(&t, tracefile) != 0)
+  {
+    fprintf(stderr, "%s: cannot read trace\n", tracefile);
+    return 1;
+  }
+  while (r == 0 && (count = traceNext(&t, &block)) > 0)
+    r = stackDistRun(&sd, block, count);
+  if (r < 0 || t.error)
+    return 1;
+  traceClose(&t);
 
-void cacheDisplay()
+  if (r > 0)
+  {
+    stackDistFree(&sd);
+    fprintf(stderr, "%s: snooped invalidates reorder caches of different sizes "
+                    "differently, simulating every size instead\n", tracefile);
+    return simulateCurve(tracefile, cfg);
+  }
+
+  cachePrintHeader();
+  for (level = 0; level < sd.levels; level++)
+  {
+    for (ways = 1; ways <= sd.ways; ways++)
+    {
+      point.sets = 1u << level;
+      point.ways = ways;
+      stackDistPoint(&sd, level, ways, &stats);
+      cachePrintRow(&point, &stats);
+    }
+  }
+  stackDistFree(&sd);
+  return 0;
+}
+
+// choose the mode an option asks for, unless another was chosen already
+static int chooseMode(int *mode, int m)
 {
-   int index;
-   int way;
-   ofp = fopen("display.txt", "a");
-
-   for (index = 0; index <= MAXLINE; index++)
-   {
-      if (testIndex(index,way) == 0)
-       {
-
-           fprintf(ofp,"INDEX: 0x%-8x\n",index);
-           fflush(ofp);
-
-           for (way = 0; way <= MAXWAY; way++)
-          {
-             fprintf(ofp,"WAY %-8d LRU: %-4d MESI: %-10d TAG: %-8d"
-                          " ADDR: 0x%-8x\n",
-                          way,
-                          L2cache[index][way].LRUbits,
-                          L2cache[index][way].MESIbits,
-                          L2cache[index][way].tag,
-                          L2cache[index][way].address);
-             fflush(ofp);
-          }
-      }
-   }
-
-   fprintf(ofp,"---------------------------------------------------------------------\n");
-   fflush(ofp);
+  if (*mode != MODE_CACHES && *mode != m)
+  {
+    fprintf(stderr, "%s and %s cannot be combined\n", modes[*mode].option, modes[m].option);
+    return -1;
+  }
+  *mode = m;
+  return 0;
 }
 
-int main()
+static void usage(const char *prog)
 {
-  memset(L2cache, 0, sizeof (cacheLine));
+  fprintf(stderr, "usage: %s [-f config] [-s sets] [-w ways] [-l linesize] [-a addrbits]\n"
+                  "          [-r policy] [-k kernel] [-c key=value,...] [-m] [-j threads]\n"
+                  "          [-b tracelist] [-n count] [-W checkpoint] [-R checkpoint]\n"
+                  "          [-p key=value,...] [-P cores] [-D key=value,...]\n"
+                  "          [-H key=value,...] [-M key=value,...] [-F key=value,...]\n"
+                  "          [-C] [tracefile]\n"
+                  "  -f  read 'key = value' settings (sets, ways, line, addrbits, policy, kernel)\n"
+                  "  -s  number of sets (default %d), 16K style suffixes allowed\n"
+                  "  -w  ways per set, 1 to %d (default %d)\n"
+                  "  -l  line size in bytes (default %d)\n"
+                  "  -a  significant address bits (default %d)\n"
+                  "  -r  replacement policy: lru (default), plru, srrip, brrip,\n"
+                  "      drrip, fifo or random\n"
+                  "  -k  'generic' to skip the kernels specialized for 1-16 way,\n"
+                  "      64-byte line geometries (default 'auto')\n"
+                  "  -c  add a cache to simulate: the settings so far changed by the\n"
+                  "      given ones, e.g. -c ways=8,policy=srrip; repeat for up to %d\n"
+                  "      caches driven by one pass over the trace\n"
+                  "  -m  print the LRU stats of every power-of-two number of sets and\n"
+                  "      every number of ways up to the given ones (up to %d ways)\n"
+                  "  -j  split the sets of a single cache between up to %d threads\n"
+                  "  -b  run every trace in a directory, or listed one per line in a\n"
+                  "      file, against every cache on a pool of -j threads (default\n"
+                  "      one per CPU) and print one table of stats\n"
+                  "  -n  run only the next count references of the trace, 1M style\n"
+                  "      suffixes allowed\n"
+                  "  -W  write a checkpoint of the cache when the run ends\n"
+                  "  -R  start from a checkpoint instead of an empty cache, at the\n"
+                  "      reference of the trace where it was written; the geometry\n"
+                  "      and policy are the checkpoint's\n"
+                  "  -p  estimate the stats from a sample: sets=n simulates 1 in n\n"
+                  "      sets, period=p,warm=w,detail=d simulates the last w+d of\n"
+                  "      every p references and counts the last d, e.g.\n"
+                  "      -p sets=32,period=10M,warm=100K,detail=1M\n"
+                  "  -P  simulate up to %d cores, each with a private cache of the\n"
+                  "      given geometry, kept coherent with MESI on a snooping bus;\n"
+                  "      a reference's core is the trace's third field\n"
+                  "  -D  with -P, keep the cores coherent with a sparse directory\n"
+                  "      instead: entries=n (default as many as the cores' lines),\n"
+                  "      ways=n (8), sharers=full, coarse or pointers, group=n\n"
+                  "      cores a coarse bit (4), pointers=n per entry (4)\n"
+                  "  -H  put L1 instruction and data caches in front of the cache\n"
+                  "      and an L3 behind it if asked: l1i=setsxways (64x8),\n"
+                  "      l1d=setsxways (64x8), l3=setsxways (none), inclusion=\n"
+                  "      inclusive (default), exclusive or nine, l1lat=, l2lat=,\n"
+                  "      l3lat=cycles (4, 14, 40), stream=file to write the L2's\n"
+                  "      requests as a binary trace\n"
+                  "  -M  with -H, the memory behind it: channels=n (2), banks=n\n"
+                  "      per channel (16), row=bytes (8K), cas=, rcd=, rp=cycles\n"
+                  "      (42 each), burst=cycles a line (8), buffer=writeback\n"
+                  "      buffer entries (16), mhz=core clock (3000)\n"
+                  "  -F  prefetch into the cache: next=n lines after a miss, stride=n\n"
+                  "      regions remembered, streams=n trackers; degree=n lines a\n"
+                  "      stride asks for (2), depth=n lines a stream runs ahead (8),\n"
+                  "      region=bytes (4K), lead=references a prefetch takes (16)\n"
+                  "  -C  sort the misses of reads, writes and fetches into compulsory,\n"
+                  "      capacity, conflict and coherence misses\n",
+                  prog, DEFAULT_SETS, MAXWAYS, DEFAULT_WAYS, DEFAULT_LINESIZE,
+                  DEFAULT_ADDRBITS, MAXCACHES, STACK_MAXWAYS, MAXTHREADS, MAXCORES);
+  exit(1);
+}
 
-  // initialize the counters
-  int refCount = 0;
-  int readCount = 0;
-  int writeCount = 0;
-  int hitCount = 0;
-  int missCount = 0;
-  int hitM = 0;
-  int hit = 0;
-  int way;
+int main(int argc, char *argv[])
+{
+  // the tracefile is testfile.din unless another is named on the command line
+  // it may be text or the binary format written by din2bin
+  const char *tracefile = "testfile.din";
+  const char *key;
+  cacheConfig cfg;
+  cacheConfig cfgs[MAXCACHES];
+  static cache L2cache[MAXCACHES];
+  char displayName[MAXCACHES][32];
+  int caches = 0;
+  int mode = MODE_CACHES;
+  int used = 0;
+  int threads = 0;
+  const char *batch = NULL;
+  const char *saveName = NULL;
+  const char *restoreName = NULL;
+  uint64_t limit = UINT64_MAX;
+  uint64_t skip = 0;
+  sampleConfig sample = { 1, 0, 0, 0 };
+  int cores = 0;
+  dirConfig dcfg;
+  int useDirectory = 0;
+  hierConfig hcfg;
+  dramConfig mcfg;
+  int useMemory = 0;
+  prefetchConfig fcfg;
+  int opt, i, err;
 
-  // initialize the input from the tracefile
-  int n;
-  int addr;
+  PROFILE_START();
 
-  // initialize the LRU bits to the way
-  setLRUbitsToWay();
+  // options are applied in order, so later ones override a config file
+  cacheDefaults(&cfg);
+  dirDefaults(&dcfg);
+  hierDefaults(&hcfg);
+  dramDefaults(&mcfg);
+  prefetchDefaults(&fcfg);
+  while ((opt = getopt(argc, argv, "f:s:w:l:a:r:k:c:mj:b:n:W:R:p:P:D:H:M:F:C")) != -1)
+  {
+    switch (opt)
+    {
+      case 'f':
+        if (cacheConfigFile(&cfg, optarg) != 0)
+          return 1;
+        continue;
+      case 'c':
+        if (caches == MAXCACHES)
+        {
+          fprintf(stderr, "at most %d caches\n", MAXCACHES);
+          return 1;
+        }
+        cfgs[caches] = cfg;
+        if (cacheConfigSpec(&cfgs[caches], optarg) != 0)
+          usage(argv[0]);
+        caches++;
+        used |= TAKES_C;
+        continue;
+      case 'm':
+        if (chooseMode(&mode, MODE_CURVE) != 0)
+          return 1;
+        continue;
+      case 'j':
+        threads = atoi(optarg);
+        if (threads < 1 || threads > MAXTHREADS)
+          usage(argv[0]);
+        if (threads > 1)
+          used |= TAKES_J;
+        continue;
+      case 'b':
+        if (chooseMode(&mode, MODE_BATCH) != 0)
+          return 1;
+        batch = optarg;
+        continue;
+      case 'n':
+        if (parseSize(optarg, &limit) != 0)
+          usage(argv[0]);
+        used |= TAKES_N;
+        continue;
+      case 'W':
+        saveName = optarg;
+        used |= TAKES_W;
+        continue;
+      case 'R':
+        restoreName = optarg;
+        used |= TAKES_R;
+        continue;
+      case 'p':
+        if (sampleConfigSpec(&sample, optarg) != 0)
+          usage(argv[0]);
+        if (chooseMode(&mode, MODE_SAMPLE) != 0)
+          return 1;
+        continue;
+      case 'P':
+        cores = atoi(optarg);
+        if (cores < 1 || cores > MAXCORES)
+          usage(argv[0]);
+        if (chooseMode(&mode, MODE_CORES) != 0)
+          return 1;
+        continue;
+      case 'D':
+        if (dirConfigSpec(&dcfg, optarg) != 0)
+          usage(argv[0]);
+        useDirectory = 1;
+        continue;
+      case 'H':
+        if (hierConfigSpec(&hcfg, optarg) != 0)
+          usage(argv[0]);
+        if (chooseMode(&mode, MODE_HIERARCHY) != 0)
+          return 1;
+        continue;
+      case 'M':
+        if (dramConfigSpec(&mcfg, optarg) != 0)
+          usage(argv[0]);
+        useMemory = 1;
+        continue;
+      case 'F':
+        if (prefetchConfigSpec(&fcfg, optarg) != 0)
+          usage(argv[0]);
+        if (chooseMode(&mode, MODE_PREFETCH) != 0)
+          return 1;
+        continue;
+      case 'C':
+        if (chooseMode(&mode, MODE_CLASSIFY) != 0)
+          return 1;
+        continue;
+      case 's':
+        key = "sets";
+        break;
+      case 'w':
+        key = "ways";
+        break;
+      case 'l':
+        key = "line";
+        break;
+      case 'a':
+        key = "addrbits";
+        break;
+      case 'r':
+        key = "policy";
+        break;
+      case 'k':
+        key = "kernel";
+        break;
+      default:
+        usage(argv[0]);
+    }
+    if (cacheConfigOption(&cfg, key, optarg) != 0)
+      usage(argv[0]);
+  }
+  if (optind < argc)
+    tracefile = argv[optind];
 
-  // open the tracefile, make it available to 'r' read
-  // open the output file to make it available to append each iteration's result
-  ifp = fopen("testfile.din", "r");
-  ofp = fopen("display.txt", "w");
+  tagMatchInit();
 
-  // set it up to read line by line, set n and addr accordingly
-  while (fscanf(ifp, "%d %x\n", &n, &addr) != EOF) 
+  for (i = 0; i < TAKES_OPTIONS; i++)
   {
-    // parse 32-bit hex address
-    int tag = addr >> 20;
-    int index = (addr >> 6) & 16383;
-    // get 1 bit from the fifth position to check later whether 1 or 0
-    // int byteSelect = (addr >> 5) & ~(~0 << 1);
-    refCount++;
+    if (used & ~modes[mode].takes & (1 << i))
+    {
+      fprintf(stderr, "%s cannot be combined with %s\n", modes[mode].option,
+              takesNames[i]);
+      return 1;
+    }
+  }
+  if (useDirectory && mode != MODE_CORES)
+  {
+    fprintf(stderr, "-D keeps the cores of -P coherent\n");
+    return 1;
+  }
+  if (useMemory && mode != MODE_HIERARCHY)
+  {
+    fprintf(stderr, "-M is the memory behind the caches of -H\n");
+    return 1;
+  }
+  if (mode == MODE_CLASSIFY)
+    return runClassify(tracefile, &cfg, limit);
+  if (mode == MODE_PREFETCH)
+    return runPrefetch(tracefile, &cfg, &fcfg, limit);
+  if (mode == MODE_HIERARCHY)
+    return runHierarchy(tracefile, &cfg, &hcfg, &mcfg, limit);
+  if (mode == MODE_CORES)
+    return runCores(tracefile, &cfg, cores, useDirectory ? &dcfg : NULL, limit);
+  if (mode == MODE_CURVE)
+    return missCurve(tracefile, &cfg);
+  if (mode == MODE_BATCH)
+  {
+    if (caches == 0)
+      cfgs[caches++] = cfg;
+    if (threads == 0)
+      threads = sysconf(_SC_NPROCESSORS_ONLN);
+    return batchRun(batch, cfgs, caches, threads);
+  }
+  if (threads > 1 && caches > 1)
+  {
+    fprintf(stderr, "-j runs a single cache, not several given with -c\n");
+    return 1;
+  }
+  if ((saveName != NULL || restoreName != NULL) && caches > 1)
+  {
+    fprintf(stderr, "-W and -R checkpoint a single cache, not several given with -c\n");
+    return 1;
+  }
 
-    switch (n) 
+  // without -c there is the one cache the options describe, displayed to
+  // display.txt; with -c, cache i displays to display-i.txt
+  if (caches == 0)
+  {
+    cfgs[caches++] = cfg;
+    strcpy(displayName[0], "display.txt");
+  }
+  else
+  {
+    for (i = 0; i < caches; i++)
+      sprintf(displayName[i], "display-%d.txt", i + 1);
+  }
+  if (restoreName != NULL)
+  {
+    if (cacheRestore(&L2cache[0], restoreName, &cfg, displayName[0], &skip) != 0)
+      return 1;
+  }
+  else
+  {
+    for (i = 0; i < caches; i++)
     {
-      // n = 0 read data request from L1 cache
-      // n = 2 instruction fetch (treated as a read request from L1 cache)
-      case 0:
-      case 2:
-	readCount++;
-        way = checkTag(index, tag);
-        // if the tag exists
-	if (way <= MAXWAY)
-	{
-	   int MESI = L2cache[index][way].MESIbits;
-	   // if this tag exists and it's valid as per its MESI bits
-	   if (MESI == M || MESI == E || MESI == S)
-	   {
-	      hitCount++;
-	      updateLRU(index, way);
-              // MESI remains unchanged
-  	   }
-           // if this tag exists but it's been invalidated and can't be used...
-           // we fetch from DRAM and pass on to L1 cache, update to exclusive
-	   else 
-           {
-	      missCount++;
-              updateLRU(index, way);
-	      L2cache[index][way].MESIbits = E;
-	   }
-	}
-        // this tag simply doesn't exist in the cache in any form
-        else
-  	{
-	   missCount++;
-	   // use the LRU bits to determine which way to evict
-	   way = checkLRU(index);
-           updateLRU(index, way);
-           L2cache[index][way].tag = tag;
-	   L2cache[index][way].MESIbits = E;
-        }
-        L2cache[index][way].address = addr;
-	break;
-      // 1 write data request from L1 cache
-      case 1:
-	writeCount++; 
-        way = checkTag(index, tag);
-	if (way <= MAXWAY)
-	{
-	   int MESI = L2cache[index][way].MESIbits;
-	   // if this tag exists and it's valid per its MESI bits...
-	   if (MESI == M || MESI == E || MESI == S)
-	      hitCount++;
-           // if this tag exists MESI bits say invalid, needs to be set M
-           else
-              missCount++;
-        }
-        // if this tag simply doesn't exist in the cache in any form...
-        // this covers the very unlikely odd case where L1 has what L2 doesn't
-        else
-  	{
-	   missCount++;
-	   way = checkLRU(index);
-           L2cache[index][way].tag = tag;
-        }
-        updateLRU(index, way);
-        L2cache[index][way].MESIbits = M;
-        L2cache[index][way].address = addr;
-      break;
-      // 4 snooped a read request from another processor
-      case 4:
-	readCount++;
-        way = checkTag(index, tag);
-        // if the tag exists
-	if (way <= MAXWAY)
-	{
-	   int MESI = L2cache[index][way].MESIbits;
-	   // if this tag exists and is valid and modified per its MESI bits...
-	   if (MESI == M || MESI == E || MESI == S)
-	   {
-	      hitCount++;
-	      // if modified, send copy to other cache, then L1, then to DRAM
-              if (MESI == M)
-                 hitM++;
-              else
-                 hit++;
-              // then set MESI to shared
-	      L2cache[index][way].MESIbits = S;
-              L2cache[index][way].address = addr;
-           }
-	   // if the tag exists but it's invalid then we don't have it...
-           else
-              missCount++;
-        }
-      break;
-      // 3 snooped invalidate command from another processor
-      // 5 snooped write request from another processor
-      case 3:
-      case 5:
-        if (n == 5)
-           writeCount++;
-        way = checkTag(index, tag);
-        // if the tag exists...
-	if (way <= MAXWAY)
-	{
-	   int MESI = L2cache[index][way].MESIbits;
-	   if (MESI == M || MESI == E || MESI == S)
-              {
-                 hitCount++;
-	         L2cache[index][way].MESIbits = I;
-                 L2cache[index][way].address = addr;
-                 updateLRU(index, way);
-              }
-	   else
-              missCount++;
-        }
-        else
-           missCount++;
-      break;
-      // 6 snooped read for ownership request
-      case 6:
-	readCount++;
-        way = checkTag(index, tag);
-        // if the tag exists
-	if (way <= MAXWAY)
-	{
-	   int MESI = L2cache[index][way].MESIbits;
-   	   // serve if modified tag exists, then invalidate
-	   if (MESI == M || MESI == E || MESI == S)
-           {
-              hitCount++;
-              if (MESI == M) 
-                 hitM++;
-              L2cache[index][way].MESIbits = I;
-              updateLRU(index, way); 
-              L2cache[index][way].address = addr;
-           }
-           else // if we don't have it, do nothing
-              missCount++;         
-       }
-      break;
-      // 8 clear the cache entirely
-      case 8:
-        fprintf(ofp,"Reference %d called for the cache to be reset. No ways are valid.\n"
-                    "---------------------------------------------------------------------\n",
-                    refCount);
-        fflush(ofp);
-        setLRUbitsToWay();
-      break;
-      // 9 print the cache but change/destroy nothing
-      case 9:
-        fprintf(ofp,"Reference %d displayed only indices containing valid ways.\n",refCount);
-        fflush(ofp);
-        cacheDisplay();
-        break;
-    } // end switch statement
-  } // end while loop
+      if (cacheCreate(&L2cache[i], &cfgs[i], displayName[i]) != 0)
+        return 1;
+    }
+  }
+
+  if (mode == MODE_SAMPLE)
+  {
+    err = runSample(tracefile, &L2cache[0], &sample, skip, limit);
+    cacheFree(&L2cache[0]);
+    return err;
+  }
 
-  float hitRatio = (float) hitCount / refCount;
-  
-  printf(" Total References: %d\n Reads: %d\n Writes: %d\n Hits: %d\n"
-         " Misses %d\n Hit ratio: %f\n"
-         "---------------------------------------------------------------------\n",
-         refCount,readCount,writeCount,hitCount,missCount,hitRatio);
-  fflush(ofp);
+  err = runCaches(tracefile, L2cache, caches, threads, skip, limit);
+  if (err)
+    return err;
+  // every reference of the trace run so far, from the start or from the
+  // checkpoint, was counted, so the count is where the trace was left
+  if (saveName != NULL &&
+      cacheSave(&L2cache[0], saveName, L2cache[0].stats.refCount) != 0)
+    return 1;
+
+  if (caches == 1)
+    cachePrintStats(&L2cache[0]);
+  else
+  {
+    cachePrintHeader();
+    for (i = 0; i < caches; i++)
+      cachePrintRow(&L2cache[i].config, &L2cache[i].stats);
+  }
+  for (i = 0; i < caches; i++)
+    cacheFree(&L2cache[i]);
 
   return 0;
 
@@ -0,0 +1,337 @@
+/* model.c
+ *
+ * The reference model 'make test' checks main against: the single cache
+ * written as plainly as possible, with none of main's speedups. Ways are
+ * searched one by one, each way keeps its own LRU rank as a counter, the
+ * address is split with / and %, a reset clears every set there and then
+ * and op 9 walks every set. It reads text traces with fgets and binary
+ * ones with fread, and writes display.txt and prints the final stats as
+ * main does, so the two can be compared byte for byte.
+ *
+ * usage: model [-s sets] [-w ways] [-l linesize] [-a addrbits] [-r lru|fifo]
+ *              [tracefile]
+ *
+ * Only LRU and FIFO replacement are modelled.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define M 0
+#define E 1
+#define S 2
+#define I 3
+
+#define MAXWAYS 16
+
+typedef struct
+{
+  uint32_t tag;
+  int MESI;
+  int rank;            // 0 is the next victim, ways - 1 the last used
+  uint32_t address;    // the last address referenced in the way
+} line;
+
+static unsigned sets = 16384, ways = 16, lineSize = 64, addrBits = 32;
+static int fifo;
+static line *cache;
+
+static long long refCount, readCount, writeCount, hitCount, missCount;
+static long long fills, writebacks;
+
+static FILE *ofp;
+
+static line *way(uint32_t index, unsigned w)
+{
+  return &cache[(size_t) index * ways + w];
+}
+
+static void reset()
+{
+  uint32_t index;
+  unsigned w;
+
+  for (index = 0; index < sets; index++)
+    for (w = 0; w < ways; w++)
+    {
+      way(index, w)->tag = 0;
+      way(index, w)->MESI = I;
+      way(index, w)->rank = w;
+    }
+}
+
+// make way w the last used of its set
+static void promote(uint32_t index, unsigned w)
+{
+  unsigned v;
+
+  for (v = 0; v < ways; v++)
+    if (way(index, v)->rank > way(index, w)->rank)
+      way(index, v)->rank--;
+  way(index, w)->rank = ways - 1;
+}
+
+// a valid way holding the tag, else an invalid one still holding it, else -1
+static int lookup(uint32_t index, uint32_t tag)
+{
+  unsigned w;
+
+  for (w = 0; w < ways; w++)
+    if (way(index, w)->tag == tag && way(index, w)->MESI != I)
+      return w;
+  for (w = 0; w < ways; w++)
+    if (way(index, w)->tag == tag)
+      return w;
+  return -1;
+}
+
+static int victim(uint32_t index)
+{
+  unsigned w;
+
+  for (w = 0; w < ways; w++)
+    if (way(index, w)->rank == 0)
+      return w;
+  return 0;
+}
+
+// a miss on op 0, 1 or 2: bring the line in, in the given state, into
+// the invalid way w still holding it or else the victim; returns the way
+static int fill(uint32_t index, uint32_t tag, int w, int MESI)
+{
+  missCount++;
+  fills++;
+  if (w < 0)
+  {
+    w = victim(index);
+    if (way(index, w)->MESI == M)
+      writebacks++;
+    way(index, w)->tag = tag;
+  }
+  promote(index, w);
+  way(index, w)->MESI = MESI;
+  return w;
+}
+
+static void display()
+{
+  uint32_t index;
+  unsigned w;
+  int valid;
+
+  for (index = 0; index < sets; index++)
+  {
+    valid = 0;
+    for (w = 0; w < ways; w++)
+      valid |= way(index, w)->MESI != I;
+    if (!valid)
+      continue;
+    fprintf(ofp, "INDEX: 0x%-8x\n", index);
+    for (w = 0; w < ways; w++)
+      fprintf(ofp, "WAY %-8d LRU: %-4d MESI: %-10d TAG: %-8u ADDR: 0x%-8x\n",
+              w, way(index, w)->rank, way(index, w)->MESI, way(index, w)->tag,
+              way(index, w)->address);
+  }
+  fprintf(ofp, "---------------------------------------------------------------------\n");
+}
+
+static void reference(unsigned n, uint32_t addr)
+{
+  uint64_t block = (addr & (uint32_t) ((1ull << addrBits) - 1)) / lineSize;
+  uint32_t index = block % sets;
+  uint32_t tag = block / sets;
+  int w = lookup(index, tag);
+  int hit = w >= 0 && way(index, w)->MESI != I;
+
+  refCount++;
+  switch (n)
+  {
+    case 0:
+    case 2:
+      readCount++;
+      if (hit)
+      {
+        hitCount++;
+        if (!fifo)
+          promote(index, w);
+      }
+      else
+        w = fill(index, tag, w, E);
+      way(index, w)->address = addr;
+      break;
+    case 1:
+      writeCount++;
+      if (hit)
+      {
+        hitCount++;
+        if (!fifo)
+          promote(index, w);
+      }
+      else
+        w = fill(index, tag, w, M);
+      way(index, w)->MESI = M;
+      way(index, w)->address = addr;
+      break;
+    case 4:
+      readCount++;
+      if (hit)
+      {
+        hitCount++;
+        way(index, w)->MESI = S;
+        way(index, w)->address = addr;
+      }
+      else if (w >= 0)
+        missCount++;
+      break;
+    case 3:
+    case 5:
+      if (n == 5)
+        writeCount++;
+      if (hit)
+      {
+        hitCount++;
+        way(index, w)->MESI = I;
+        way(index, w)->address = addr;
+        if (!fifo)
+          promote(index, w);
+      }
+      else
+        missCount++;
+      break;
+    case 6:
+      readCount++;
+      if (hit)
+      {
+        hitCount++;
+        way(index, w)->MESI = I;
+        way(index, w)->address = addr;
+        if (!fifo)
+          promote(index, w);
+      }
+      else if (w >= 0)
+        missCount++;
+      break;
+    case 8:
+      fprintf(ofp, "Reference %lld called for the cache to be reset. No ways are valid.\n"
+                   "---------------------------------------------------------------------\n",
+              refCount);
+      reset();
+      break;
+    case 9:
+      fprintf(ofp, "Reference %lld displayed only indices containing valid ways.\n",
+              refCount);
+      display();
+      break;
+  }
+}
+
+static unsigned count(const char *s)
+{
+  char *end;
+  unsigned long n = strtoul(s, &end, 0);
+
+  if (*end == 'K' || *end == 'k')
+    n <<= 10;
+  else if (*end == 'M' || *end == 'm')
+    n <<= 20;
+  return n;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-s sets] [-w ways] [-l linesize] [-a addrbits]"
+                  " [-r lru|fifo] [tracefile]\n", prog);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *tracefile = "testfile.din";
+  char text[4096];
+  struct
+  {
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+  } header;
+  struct
+  {
+    uint32_t addr;
+    uint8_t n, core, pad[2];
+  } record;
+  unsigned n, addr;
+  uint64_t i;
+  float hitRatio;
+  FILE *fp;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:w:l:a:r:")) != -1)
+  {
+    switch (opt)
+    {
+      case 's':
+        sets = count(optarg);
+        break;
+      case 'w':
+        ways = count(optarg);
+        break;
+      case 'l':
+        lineSize = count(optarg);
+        break;
+      case 'a':
+        addrBits = count(optarg);
+        break;
+      case 'r':
+        if (strcmp(optarg, "lru") != 0 && strcmp(optarg, "fifo") != 0)
+          usage(argv[0]);
+        fifo = strcmp(optarg, "fifo") == 0;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind < argc)
+    tracefile = argv[optind];
+  if (sets == 0 || ways == 0 || ways > MAXWAYS || lineSize == 0 ||
+      addrBits == 0 || addrBits > 32)
+    usage(argv[0]);
+
+  cache = calloc((size_t) sets * ways, sizeof (line));
+  fp = fopen(tracefile, "rb");
+  ofp = fopen("display.txt", "w");
+  if (cache == NULL || fp == NULL || ofp == NULL)
+  {
+    fprintf(stderr, "%s: cannot run\n", tracefile);
+    return 1;
+  }
+  reset();
+
+  if (fread(&header, sizeof (header), 1, fp) == 1 &&
+      memcmp(header.magic, "L2TR", 4) == 0)
+  {
+    for (i = 0; i < header.count && fread(&record, sizeof (record), 1, fp) == 1; i++)
+      reference(record.n, record.addr);
+  }
+  else
+  {
+    rewind(fp);
+    while (fgets(text, sizeof (text), fp) != NULL)
+      if (sscanf(text, "%u %x", &n, &addr) == 2)
+        reference(n, addr);
+  }
+  fclose(fp);
+  fclose(ofp);
+
+  hitRatio = refCount ? (float) hitCount / refCount : 0;
+  printf(" Total References: %lld\n Reads: %lld\n Writes: %lld\n Hits: %lld\n"
+         " Misses %lld\n Hit ratio: %f\n Writebacks: %lld\n"
+         " Memory traffic: %lld bytes read, %lld bytes written\n"
+         "---------------------------------------------------------------------\n",
+         refCount, readCount, writeCount, hitCount, missCount, hitRatio, writebacks,
+         fills * lineSize, writebacks * lineSize);
+  return 0;
+}
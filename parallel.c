@@ -0,0 +1,211 @@
+/* parallel.c
+ *
+ * The reader and worker threads of a parallel run, see parallel.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "parallel.h"
+
+// records per worker queue, a power of two (512KB)
+#define QUEUE_SIZE 65536
+
+// the reader makes the records it has queued visible this often
+#define PUBLISH 1024
+
+// spins on an empty or full queue before giving up the CPU
+#define SPINS 64
+
+// the head is written by the worker only and the tail by the reader only,
+// each on its own host cache line
+typedef struct
+{
+  _Alignas(64) _Atomic size_t head;
+  _Alignas(64) _Atomic size_t tail;
+  _Alignas(64) size_t pending;         // the reader's tail, not yet published
+  traceRecord *ring;
+  cache c;
+  _Atomic int *done;
+  pthread_t thread;
+} worker;
+
+static void wait(int *spins)
+{
+  if (++*spins >= SPINS)
+  {
+     sched_yield();
+     *spins = 0;
+  }
+}
+
+// run the queued references through this worker's sets until the reader
+// is done and the queue is empty
+static void *workerMain(void *arg)
+{
+  worker *w = arg;
+  size_t head = atomic_load_explicit(&w->head, memory_order_relaxed);
+  size_t tail, n;
+  int spins = 0;
+
+  for (;;)
+  {
+     tail = atomic_load_explicit(&w->tail, memory_order_acquire);
+     if (head == tail)
+     {
+        if (atomic_load_explicit(w->done, memory_order_acquire) &&
+            head == atomic_load_explicit(&w->tail, memory_order_acquire))
+           break;
+        wait(&spins);
+        continue;
+     }
+     spins = 0;
+     // the queued records, in at most two runs around the ring
+     while (head != tail)
+     {
+        n = QUEUE_SIZE - (head & (QUEUE_SIZE - 1));
+        if (n > tail - head)
+           n = tail - head;
+        cacheRun(&w->c, w->ring + (head & (QUEUE_SIZE - 1)), n);
+        head += n;
+     }
+     atomic_store_explicit(&w->head, head, memory_order_release);
+  }
+  return NULL;
+}
+
+static void publish(worker *w)
+{
+  atomic_store_explicit(&w->tail, w->pending, memory_order_release);
+}
+
+// queue one reference, waiting for room if the worker is behind
+static void push(worker *w, const traceRecord *r)
+{
+  int spins = 0;
+
+  if (w->pending - atomic_load_explicit(&w->head, memory_order_acquire) == QUEUE_SIZE)
+  {
+     publish(w);
+     while (w->pending - atomic_load_explicit(&w->head, memory_order_acquire) == QUEUE_SIZE)
+        wait(&spins);
+  }
+  w->ring[w->pending & (QUEUE_SIZE - 1)] = *r;
+  w->pending++;
+  if ((w->pending & (PUBLISH - 1)) == 0)
+     publish(w);
+}
+
+// wait until every worker has run everything queued, then fold their
+// stats into the cache
+static void drain(cache *c, worker *workers, int threads)
+{
+  int i, spins = 0;
+
+  for (i = 0; i < threads; i++)
+     publish(&workers[i]);
+  for (i = 0; i < threads; i++)
+  {
+     while (atomic_load_explicit(&workers[i].head, memory_order_acquire) != workers[i].pending)
+        wait(&spins);
+  }
+  for (i = 0; i < threads; i++)
+  {
+     cacheStats *s = &workers[i].c.stats;
+     c->stats.refCount += s->refCount;
+     c->stats.readCount += s->readCount;
+     c->stats.writeCount += s->writeCount;
+     c->stats.hitCount += s->hitCount;
+     c->stats.missCount += s->missCount;
+     c->stats.hitM += s->hitM;
+     c->stats.hit += s->hit;
+     c->stats.fills += s->fills;
+     c->stats.writebacks += s->writebacks;
+     memset(s, 0, sizeof (cacheStats));
+  }
+}
+
+// run the rest of the trace against the cache on the given number of
+// worker threads; returns -1, after saying why, if it cannot
+int parallelRun(cache *c, trace *t, int threads)
+{
+  worker *workers;
+  _Atomic int done = 0;
+  const traceRecord *block;
+  size_t count, i;
+  uint32_t index, tag;
+  int k, started = 0, err = 0;
+
+  if (c->config.policy == REPL_DRRIP)
+  {
+     fprintf(stderr, "drrip shares one PSEL counter between all sets and "
+                     "cannot be run on several threads\n");
+     return -1;
+  }
+  if (threads < 1 || threads > MAXTHREADS)
+  {
+     fprintf(stderr, "threads must be 1 to %d\n", MAXTHREADS);
+     return -1;
+  }
+
+  workers = aligned_alloc(64, threads * sizeof (worker));
+  if (workers == NULL)
+  {
+     fprintf(stderr, "cannot allocate %d workers\n", threads);
+     return -1;
+  }
+  memset(workers, 0, threads * sizeof (worker));
+  for (k = 0; k < threads && !err; k++)
+  {
+     worker *w = &workers[k];
+     w->ring = malloc(QUEUE_SIZE * sizeof (traceRecord));
+     w->c = *c;
+     memset(&w->c.stats, 0, sizeof (cacheStats));
+     w->done = &done;
+     if (w->ring == NULL || pthread_create(&w->thread, NULL, workerMain, w) != 0)
+     {
+        fprintf(stderr, "cannot start %d threads\n", threads);
+        err = 1;
+        break;
+     }
+     started++;
+  }
+
+  while (!err && (count = traceNext(t, &block)) > 0)
+  {
+     for (i = 0; i < count; i++)
+     {
+        switch (block[i].n)
+        {
+          // reset and display are barriers, run by the reader on the
+          // whole cache
+          case 8:
+          case 9:
+            drain(c, workers, started);
+            cacheRun(c, &block[i], 1);
+            // the workers' copies have to follow a reset into the new epoch
+            for (k = 0; k < started; k++)
+               workers[k].c.epoch = c->epoch;
+            break;
+          default:
+            splitAddress(c, block[i].addr, &index, &tag, 0);
+            push(&workers[(index / 64) % threads], &block[i]);
+        }
+     }
+  }
+
+  if (started > 0)
+     drain(c, workers, started);
+  atomic_store_explicit(&done, 1, memory_order_release);
+  for (k = 0; k < started; k++)
+     pthread_join(workers[k].thread, NULL);
+  for (k = 0; k < threads; k++)
+     free(workers[k].ring);
+  free(workers);
+  return err ? -1 : 0;
+}
@@ -0,0 +1,33 @@
+/* parallel.h
+ *
+ * Running one trace against one cache on several threads.
+ *
+ * Every op but 8 (reset) and 9 (display) touches a single set, so the
+ * sets are dealt out to worker threads in runs of 64, (index / 64) %
+ * threads, the sets sharing a word of the occupancy bitmap. The
+ * calling thread reads the trace and scatters each reference into its
+ * worker's single producer, single consumer queue. Each worker runs the
+ * cache's own kernel over its queue, on a copy of the cache that shares
+ * the sets but keeps its own stats.
+ *
+ * An 8 or 9 waits until every queue is empty, adds the workers' stats
+ * into the cache and is then run by the reader itself, so the reset and
+ * display see the same cache and reference count as a serial run and the
+ * output is identical.
+ *
+ * DRRIP keeps one PSEL counter for all sets and cannot be split this way.
+ *
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "trace.h"
+#include "cache.h"
+
+// at most this many workers
+#define MAXTHREADS 256
+
+int parallelRun(cache *c, trace *t, int threads);
+
+#endif
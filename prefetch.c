@@ -0,0 +1,355 @@
+/* prefetch.c
+ *
+ * Running a trace through a cache with prefetchers watching its demand
+ * references, see prefetch.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefetch.h"
+
+static const char *kindNames[PF_KINDS] = { "demand", "next", "stride", "stream" };
+
+void prefetchDefaults(prefetchConfig *cfg)
+{
+  cfg->next = 0;
+  cfg->stride = 0;
+  cfg->streams = 0;
+  cfg->degree = 2;
+  cfg->depth = 8;
+  cfg->region = 4096;
+  cfg->lead = 16;
+}
+
+// apply a comma separated list of key=value settings, e.g.
+// "next=1,stride=256,degree=4"
+int prefetchConfigSpec(prefetchConfig *cfg, const char *spec)
+{
+  char buf[256];
+  char *item, *value, *save;
+  int err;
+
+  if (strlen(spec) >= sizeof (buf))
+     return -1;
+  strcpy(buf, spec);
+  for (item = strtok_r(buf, ",", &save); item != NULL;
+       item = strtok_r(NULL, ",", &save))
+  {
+     value = strchr(item, '=');
+     if (value == NULL)
+        return -1;
+     *value++ = '\0';
+     if (strcmp(item, "next") == 0)
+        err = parseCount(value, &cfg->next);
+     else if (strcmp(item, "stride") == 0)
+        err = parseCount(value, &cfg->stride);
+     else if (strcmp(item, "streams") == 0)
+        err = parseCount(value, &cfg->streams);
+     else if (strcmp(item, "degree") == 0)
+        err = parseCount(value, &cfg->degree);
+     else if (strcmp(item, "depth") == 0)
+        err = parseCount(value, &cfg->depth);
+     else if (strcmp(item, "region") == 0)
+        err = parseCount(value, &cfg->region);
+     else if (strcmp(item, "lead") == 0)
+        err = parseCount(value, &cfg->lead);
+     else
+        err = -1;
+     if (err != 0)
+        return -1;
+  }
+  return 0;
+}
+
+// returns -1, after saying why, if the prefetchers cannot be built
+int prefetchCreate(prefetcher *p, const prefetchConfig *cfg, cache *c)
+{
+  size_t lines = (size_t) c->config.sets * c->config.ways;
+
+  memset(p, 0, sizeof (prefetcher));
+  p->config = *cfg;
+  p->c = c;
+  if (cfg->next == 0 && cfg->stride == 0 && cfg->streams == 0)
+  {
+     fprintf(stderr, "no prefetcher asked for: give next, stride or streams\n");
+     return -1;
+  }
+  if ((cfg->region & (cfg->region - 1)) != 0 || cfg->region < c->config.lineSize)
+  {
+     fprintf(stderr, "a prefetch region must be a power of two of at least a line\n");
+     return -1;
+  }
+  p->source = calloc(lines, 1);
+  p->filled = calloc(lines, sizeof (long long));
+  p->table = calloc(cfg->stride, sizeof (strideEntry));
+  p->tracker = calloc(cfg->streams, sizeof (streamTracker));
+  if (p->source == NULL || p->filled == NULL ||
+      (cfg->stride && p->table == NULL) || (cfg->streams && p->tracker == NULL))
+  {
+     fprintf(stderr, "cannot allocate the prefetchers\n");
+     prefetchFree(p);
+     return -1;
+  }
+  return 0;
+}
+
+void prefetchFree(prefetcher *p)
+{
+  free(p->source);
+  free(p->filled);
+  free(p->table);
+  free(p->tracker);
+  memset(p, 0, sizeof (prefetcher));
+}
+
+// the line an address is in, and whether a line is in the given region
+static inline uint32_t lineOf(const cache *c, uint32_t addr)
+{
+  return divide(&c->lineDiv, addr & c->addrMask);
+}
+
+static inline int inRegion(const prefetcher *p, uint32_t line, uint32_t region)
+{
+  uint64_t addr = (uint64_t) line * p->c->config.lineSize;
+  return addr <= p->c->addrMask && addr / p->config.region == region;
+}
+
+// a prefetcher asks for a line
+static void issue(prefetcher *p, int kind, uint32_t line)
+{
+  int slot;
+
+  p->stats[kind].requests++;
+  slot = cachePrefetch(p->c, line * p->c->config.lineSize);
+  if (slot < 0)
+     return;
+  p->stats[kind].fills++;
+  // the line filled over may itself have been prefetched and never used
+  if (p->source[slot] != PF_NONE)
+     p->stats[p->source[slot]].unused++;
+  p->source[slot] = kind;
+  p->filled[slot] = p->c->stats.refCount;
+}
+
+static void nextLines(prefetcher *p, uint32_t line, uint32_t region)
+{
+  unsigned k;
+  for (k = 1; k <= p->config.next && inRegion(p, line + k, region); k++)
+     issue(p, PF_NEXT, line + k);
+}
+
+static void strideTrain(prefetcher *p, uint32_t line, uint32_t region)
+{
+  strideEntry *e = &p->table[region % p->config.stride];
+  int32_t delta;
+  unsigned k;
+
+  if (!e->valid || e->region != region)
+  {
+     e->valid = 1;
+     e->region = region;
+     e->last = line;
+     e->stride = 0;
+     e->confidence = 0;
+     return;
+  }
+  delta = (int32_t) (line - e->last);
+  if (delta == 0)
+     return;
+  e->last = line;
+  if (delta == e->stride)
+  {
+     if (e->confidence < 3)
+        e->confidence++;
+  }
+  else if (e->confidence > 0)
+     e->confidence--;
+  else
+  {
+     e->stride = delta;
+     e->confidence = 1;
+  }
+  if (e->confidence < 2)
+     return;
+  for (k = 1; k <= p->config.degree; k++)
+  {
+     uint32_t target = line + k * e->stride;
+     if (!inRegion(p, target, region))
+        break;
+     issue(p, PF_STRIDE, target);
+  }
+}
+
+static void streamTrain(prefetcher *p, uint32_t line, uint32_t region, int hit)
+{
+  int depth = p->config.depth;
+  streamTracker *s;
+  uint32_t front;
+  int32_t delta;
+  unsigned i;
+
+  for (i = 0; i < p->config.streams; i++)
+  {
+     s = &p->tracker[i];
+     if (!s->valid)
+        continue;
+     delta = (int32_t) (line - s->last);
+     if (delta == 0)
+        return;
+     if (s->dir == 0)
+     {
+        if (delta < -depth || delta > depth)
+           continue;
+        s->dir = delta > 0 ? 1 : -1;
+        s->front = line;
+     }
+     else if (delta * s->dir < 0 || delta * s->dir > depth)
+        continue;
+
+     // keep depth lines ahead of the reference asked for
+     s->last = line;
+     s->used = p->c->stats.refCount;
+     front = s->front;
+     while ((int32_t) (front + s->dir - line) * s->dir <= depth &&
+            inRegion(p, front + s->dir, region))
+     {
+        front += s->dir;
+        issue(p, PF_STREAM, front);
+     }
+     s->front = front;
+     return;
+  }
+
+  // a miss near no stream may be the start of one, in place of the stream
+  // referenced longest ago
+  if (hit)
+     return;
+  s = &p->tracker[0];
+  for (i = 1; i < p->config.streams && s->valid; i++)
+  {
+     if (!p->tracker[i].valid || p->tracker[i].used < s->used)
+        s = &p->tracker[i];
+  }
+  s->valid = 1;
+  s->last = line;
+  s->front = line;
+  s->dir = 0;
+  s->used = p->c->stats.refCount;
+}
+
+// a demand reference: run it, settle the account of a prefetched line it
+// found or filled over, and let the prefetchers see it
+static void demand(prefetcher *p, const traceRecord *r)
+{
+  cache *c = p->c;
+  long long hits = c->stats.hitCount;
+  prefetchStats *s;
+  uint32_t index, tag, line, region;
+  int way, slot, hit, used = 0;
+  long long age;
+
+  cacheRun(c, r, 1);
+  hit = c->stats.hitCount != hits;
+  if (!hit)
+     p->demandMisses++;
+
+  // the reference leaves its line valid, in the way it hit or was filled in
+  findLine(c, r->addr, &index, &tag, &way);
+  slot = index * c->config.ways + way;
+  if (p->source[slot] != PF_NONE)
+  {
+     s = &p->stats[p->source[slot]];
+     if (hit)
+     {
+        age = c->stats.refCount - p->filled[slot];
+        s->useful++;
+        s->distance += age;
+        if (age < p->config.lead)
+           s->late++;
+        used = 1;
+     }
+     else
+        s->unused++;
+     p->source[slot] = PF_NONE;
+  }
+
+  line = lineOf(c, r->addr);
+  region = (r->addr & c->addrMask) / p->config.region;
+  if (p->config.next && (!hit || used))
+     nextLines(p, line, region);
+  if (p->config.stride)
+     strideTrain(p, line, region);
+  if (p->config.streams)
+     streamTrain(p, line, region, hit);
+}
+
+// the cache was reset: what was prefetched into it went unused, and the
+// prefetchers start over
+static void forget(prefetcher *p)
+{
+  size_t i, lines = (size_t) p->c->config.sets * p->c->config.ways;
+
+  for (i = 0; i < lines; i++)
+  {
+     if (p->source[i] != PF_NONE)
+        p->stats[p->source[i]].unused++;
+  }
+  memset(p->source, 0, lines);
+  if (p->table != NULL)
+     memset(p->table, 0, p->config.stride * sizeof (strideEntry));
+  if (p->tracker != NULL)
+     memset(p->tracker, 0, p->config.streams * sizeof (streamTracker));
+}
+
+// run the rest of a trace; returns -1 if it could not all be read
+int prefetchRun(prefetcher *p, trace *t)
+{
+  const traceRecord *block;
+  size_t count, i;
+
+  while ((count = traceNext(t, &block)) > 0)
+  {
+     for (i = 0; i < count; i++)
+     {
+        if (block[i].n <= 2)
+           demand(p, &block[i]);
+        else
+        {
+           cacheRun(p->c, &block[i], 1);
+           if (block[i].n == 8)
+              forget(p);
+        }
+     }
+  }
+  return t->error ? -1 : 0;
+}
+
+void prefetchPrintStats(const prefetcher *p)
+{
+  const prefetchStats *s;
+  long long useful = 0;
+  int k;
+
+  for (k = PF_NEXT; k < PF_KINDS; k++)
+     useful += p->stats[k].useful;
+  printf("%-8s %10s %10s %10s %10s %10s %8s %8s %8s\n", "prefetch", "requests",
+         "fills", "useful", "late", "unused", "accuracy", "coverage", "distance");
+  for (k = PF_NEXT; k < PF_KINDS; k++)
+  {
+     s = &p->stats[k];
+     if ((k == PF_NEXT && !p->config.next) || (k == PF_STRIDE && !p->config.stride) ||
+         (k == PF_STREAM && !p->config.streams))
+        continue;
+     printf("%-8s %10lld %10lld %10lld %10lld %10lld %8.4f %8.4f %8.1f\n",
+            kindNames[k], s->requests, s->fills, s->useful, s->late, s->unused,
+            s->fills ? (double) s->useful / s->fills : 0,
+            p->demandMisses + useful ? (double) s->useful / (p->demandMisses + useful) : 0,
+            s->useful ? (double) s->distance / s->useful : 0);
+  }
+  printf(" Demand misses: %lld\n Demand misses without prefetching, about: %lld\n"
+         "---------------------------------------------------------------------\n",
+         p->demandMisses, p->demandMisses + useful);
+}
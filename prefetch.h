@@ -0,0 +1,114 @@
+/* prefetch.h
+ *
+ * Hardware prefetchers in front of a single cache, driven by its demand
+ * references (0, 1 and 2) and whether they hit.
+ *
+ *   next    next-N-line: a miss, or the first use of a prefetched line,
+ *           asks for the N lines after it
+ *   stride  a table of regions (4KB by default), each remembering the
+ *           last line referenced in it and the distance between the last
+ *           two; once the same distance is seen twice running, 'degree'
+ *           lines further along at that distance are asked for
+ *   stream  a few stream trackers: a miss not near any stream starts one,
+ *           a second reference close after it gives the direction, and
+ *           from then on every reference inside the stream's window keeps
+ *           'depth' lines ahead of it asked for
+ *
+ * No prefetcher asks for a line outside the region of the reference that
+ * triggered it, as a physical page ends there. A line asked for that is
+ * not already valid is filled as a miss would fill it, through the same
+ * victim choice, replacement state and writeback of a modified victim,
+ * but counts as no reference. The stream prefetcher fills the cache too
+ * rather than buffers of its own, so all three share it.
+ *
+ * Every prefetched line remembers which prefetcher filled it and when,
+ * until a demand reference uses it or it leaves the cache. A use counts
+ * the prefetch useful, and late if it came less than 'lead' references
+ * after the fill, as the line would still have been on its way; the
+ * cache counts it a hit either way. A prefetched line evicted or
+ * invalidated before any use is pollution. Accuracy is the share of fills
+ * that were useful, and coverage the share of the demand misses there
+ * would have been (those left plus the useful prefetches) that were
+ * removed.
+ *
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdint.h>
+
+#include "trace.h"
+#include "cache.h"
+
+// who filled a line; PF_NONE for a demand fill
+#define PF_NONE 0
+#define PF_NEXT 1
+#define PF_STRIDE 2
+#define PF_STREAM 3
+#define PF_KINDS 4
+
+typedef struct
+{
+  unsigned next;       // lines ahead for next-N-line, 0 for off
+  unsigned stride;     // entries in the stride table, 0 for off
+  unsigned streams;    // stream trackers, 0 for off
+  unsigned degree;     // lines a confirmed stride asks for
+  unsigned depth;      // lines a stream keeps ahead
+  unsigned region;     // bytes in a region, a power of two
+  unsigned lead;       // references a prefetch takes to arrive
+} prefetchConfig;
+
+typedef struct
+{
+  long long requests;  // lines asked for
+  long long fills;     // of those, not already in the cache
+  long long useful;    // fills a demand reference then used
+  long long late;      // of those, used within 'lead' references
+  long long unused;    // fills that left the cache unused
+  long long distance;  // references from fill to use, added up
+} prefetchStats;
+
+typedef struct
+{
+  uint32_t region;
+  uint32_t last;       // the last line referenced in the region
+  int32_t stride;
+  int confidence;      // 0 to 3, prefetching from 2
+  int valid;
+} strideEntry;
+
+typedef struct
+{
+  uint32_t last;       // the last line the stream was referenced at
+  uint32_t front;      // the furthest line asked for
+  int dir;             // +1 or -1, 0 until the second reference
+  long long used;      // when last referenced, to replace the oldest
+  int valid;
+} streamTracker;
+
+typedef struct
+{
+  prefetchConfig config;
+  cache *c;
+
+  // per line of the cache, as c->address: the prefetcher that filled it
+  // and when, by the cache's reference count
+  unsigned char *source;
+  long long *filled;
+
+  strideEntry *table;
+  streamTracker *tracker;
+
+  prefetchStats stats[PF_KINDS];
+  long long demandMisses;  // misses of ops 0, 1 and 2
+} prefetcher;
+
+void prefetchDefaults(prefetchConfig *cfg);
+int prefetchConfigSpec(prefetchConfig *cfg, const char *spec);
+int prefetchCreate(prefetcher *p, const prefetchConfig *cfg, cache *c);
+void prefetchFree(prefetcher *p);
+int prefetchRun(prefetcher *p, trace *t);
+void prefetchPrintStats(const prefetcher *p);
+
+#endif
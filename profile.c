@@ -0,0 +1,178 @@
+/* profile.c
+ *
+ * Collecting and printing the timings of a -DPROFILE build, see
+ * profile.h. Empty otherwise.
+ *
+ */
+
+#ifdef PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "profile.h"
+
+static const char *phaseNames[PROF_PHASES] =
+  { "decode", "reference", "lookup", "replacement" };
+
+__thread unsigned profileCountdown = PROFILE_PERIOD;
+static __thread uint32_t seed = 0x2545f491;
+static __thread int whole;
+
+// a phase's intervals; for decode, one per block, each counted in the
+// histogram by its ticks per reference
+static struct
+{
+  long long count;
+  uint64_t ticks;
+  long long bucket[PROFILE_BUCKETS];
+} phase[PROF_PHASES];
+
+static long long decoded;
+static long long partsTimed;   // references whose phases were timed
+static uint64_t overhead;
+static uint64_t startTicks;
+static struct timespec startTime;
+
+// the next reference to time is between a half and one and a half
+// periods away, so a trace that repeats with the period is not aliased;
+// the references picked are timed whole and in phases by turns
+int profileRearm(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  profileCountdown = PROFILE_PERIOD / 2 + seed % PROFILE_PERIOD;
+  whole = !whole;
+  if (whole)
+     return PROFILE_WHOLE;
+  __atomic_fetch_add(&partsTimed, 1, __ATOMIC_RELAXED);
+  return PROFILE_PARTS;
+}
+
+// bucket b holds intervals of 2^(b-1) up to 2^b ticks, bucket 0 none
+static int bucketOf(uint64_t ticks)
+{
+  int b = ticks ? 64 - __builtin_clzll(ticks) : 0;
+  return b < PROFILE_BUCKETS ? b : PROFILE_BUCKETS - 1;
+}
+
+static void record(int p, uint64_t ticks, uint64_t histogramTicks)
+{
+  __atomic_fetch_add(&phase[p].count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&phase[p].ticks, ticks, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&phase[p].bucket[bucketOf(histogramTicks)], 1, __ATOMIC_RELAXED);
+}
+
+void profileRecord(int p, uint64_t ticks)
+{
+  ticks = ticks > overhead ? ticks - overhead : 0;
+  record(p, ticks, ticks);
+}
+
+void profileDecoded(uint64_t ticks, size_t count)
+{
+  if (count == 0)
+     return;
+  ticks = ticks > overhead ? ticks - overhead : 0;
+  record(PROF_DECODE, ticks, ticks / count);
+  __atomic_fetch_add(&decoded, (long long) count, __ATOMIC_RELAXED);
+}
+
+static double seconds(const struct timespec *a, const struct timespec *b)
+{
+  return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+// the ticks below which a share q of a phase's intervals fell
+static uint64_t percentile(int p, double q)
+{
+  long long seen = 0;
+  int b;
+
+  for (b = 0; b < PROFILE_BUCKETS; b++)
+  {
+     seen += phase[p].bucket[b];
+     if (seen > 0 && seen >= q * phase[p].count)
+        return b ? 1ull << b : 1;
+  }
+  return 1ull << (PROFILE_BUCKETS - 1);
+}
+
+// print where the time went; registered to run at exit by profileStart()
+void profileReport(void)
+{
+  struct timespec now;
+  uint64_t ticks = profileNow() - startTicks;
+  double elapsed, nsPerTick, perRef;
+  int p, b;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed = seconds(&startTime, &now);
+  nsPerTick = ticks ? elapsed * 1e9 / ticks : 0;
+
+  fprintf(stderr, " Profile: %lld references in %.3f s, %.2f M references/s,"
+                  " %.1f ns/reference\n", decoded, elapsed,
+          elapsed > 0 ? decoded / elapsed / 1e6 : 0,
+          decoded ? elapsed * 1e9 / decoded : 0);
+  fprintf(stderr, " %-12s %10s %13s %9s %9s %9s %9s\n", "phase", "timed",
+          "ns/reference", "mean ns", "p50 ns", "p90 ns", "p99 ns");
+  for (p = 0; p < PROF_PHASES; p++)
+  {
+     if (phase[p].count == 0)
+        continue;
+     // decoding is timed for every reference, the rest for a sample of them
+     if (p == PROF_DECODE)
+        perRef = phase[p].ticks * nsPerTick / decoded;
+     else if (p == PROF_REFERENCE)
+        perRef = phase[p].ticks * nsPerTick / phase[p].count;
+     else
+        perRef = partsTimed ? phase[p].ticks * nsPerTick / partsTimed : 0;
+     fprintf(stderr, " %-12s %10lld %13.2f %9.2f %9.1f %9.1f %9.1f\n", phaseNames[p],
+             phase[p].count, perRef,
+             p == PROF_DECODE ? perRef : phase[p].ticks * nsPerTick / phase[p].count,
+             percentile(p, 0.5) * nsPerTick, percentile(p, 0.9) * nsPerTick,
+             percentile(p, 0.99) * nsPerTick);
+  }
+
+  fprintf(stderr, " %-12s", "ticks below");
+  for (p = 0; p < PROF_PHASES; p++)
+     fprintf(stderr, " %11s", phaseNames[p]);
+  fprintf(stderr, "\n");
+  for (b = 0; b < PROFILE_BUCKETS; b++)
+  {
+     long long any = 0;
+     for (p = 0; p < PROF_PHASES; p++)
+        any += phase[p].bucket[b];
+     if (any == 0)
+        continue;
+     fprintf(stderr, " %-12llu", b ? 1ull << b : 1ull);
+     for (p = 0; p < PROF_PHASES; p++)
+        fprintf(stderr, " %11lld", phase[p].bucket[b]);
+     fprintf(stderr, "\n");
+  }
+  fprintf(stderr, " (decode per reference of each block; %llu ticks taken off each"
+                  " interval for reading the clock)\n", (unsigned long long) overhead);
+}
+
+// measure the cost of reading the clock, start the clocks and arrange for
+// the report when the program exits
+void profileStart(void)
+{
+  uint64_t a, b;
+  int i;
+
+  overhead = ~0ull;
+  for (i = 0; i < 1000; i++)
+  {
+     a = profileNow();
+     b = profileNow();
+     if (b - a < overhead)
+        overhead = b - a;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &startTime);
+  startTicks = profileNow();
+  atexit(profileReport);
+}
+
+#endif
@@ -0,0 +1,103 @@
+/* profile.h
+ *
+ * Where the simulator's own time goes, when built with -DPROFILE ('make
+ * profile' builds main-profile). Without it every macro here is empty
+ * and the simulator is unchanged.
+ *
+ * The phases timed are decoding the trace, every block of it, and, for
+ * one reference in PROFILE_PERIOD picked at random intervals, either the
+ * whole reference through the op switch or, for the next one picked, the
+ * tag lookup and the replacement updates within it, so that timing the
+ * phases does not add to the time of the whole. Time is read from the
+ * TSC where there is one and from clock_gettime() otherwise, calibrated
+ * against clock_gettime() over the run, less the cost of reading it.
+ * Every interval goes into a histogram of power-of-two buckets of ticks,
+ * and the report is printed to stderr when the program exits.
+ *
+ * Only the single cache's kernels are timed beyond decoding; references
+ * not picked run the same code as without profiling, after a countdown.
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifdef PROFILE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// a reference in this many is timed, on average
+#define PROFILE_PERIOD 1024
+
+#define PROFILE_BUCKETS 40
+
+#define PROF_DECODE 0
+#define PROF_REFERENCE 1
+#define PROF_LOOKUP 2
+#define PROF_REPLACE 3
+#define PROF_PHASES 4
+
+// what profileSample() picks a reference for
+#define PROFILE_WHOLE 1
+#define PROFILE_PARTS 2
+
+// references left before the next one timed, in each thread
+extern __thread unsigned profileCountdown;
+
+static inline uint64_t profileNow(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+int profileRearm(void);
+void profileRecord(int phase, uint64_t ticks);
+void profileDecoded(uint64_t ticks, size_t count);
+void profileStart(void);
+void profileReport(void);
+
+// whether to time this reference, as a whole or its phases, or not (0)
+static inline __attribute__((always_inline)) int profileSample(void)
+{
+  if (__builtin_expect(--profileCountdown != 0, 1))
+     return 0;
+  return profileRearm();
+}
+
+#define PROFILE_TIME(timed, phase, stmt) \
+  do \
+  { \
+     if (timed) \
+     { \
+        uint64_t t0_ = profileNow(); \
+        stmt; \
+        profileRecord(phase, profileNow() - t0_); \
+     } \
+     else \
+     { \
+        stmt; \
+     } \
+  } while (0)
+
+#define PROFILE_START() profileStart()
+
+#else
+
+// timed is still used, so the callers that only pass it on stay free of
+// unused parameter warnings
+#define PROFILE_TIME(timed, phase, stmt) do { (void) (timed); stmt; } while (0)
+#define PROFILE_START()
+
+#endif
+
+#endif
@@ -0,0 +1,538 @@
+/* regress.c
+ *
+ * The regression test behind 'make test': runs main and the reference
+ * model in model.c over the same traces and checks that they print the
+ * same final stats and write the same display.txt, every op 8 note and
+ * op 9 snapshot in it, byte for byte.
+ *
+ * usage: regress [-n references] [-k]
+ *
+ * The traces are testfile.din and testcases/test*.txt, each in a few
+ * geometries, and one randomized trace of -n references (1M) per case
+ * below, written by ./tracegen with every op from 0 to 9. main is run on
+ * some of them with -k generic or -j 4 as well, which must not change
+ * anything. Each check runs in a directory of its own under /tmp, which
+ * is removed if it passed unless -k is given. A mismatch is reported with
+ * the first line that differs and the reference whose snapshot or note it
+ * is in.
+ *
+ * Each text trace is also run from a checkpoint main wrote partway
+ * through, saving the checkpoint again to the same file it was restored
+ * from, and the stats must be those of the full run.
+ *
+ * The sampled runs of -p are checked against full runs of main: over the
+ * text traces a sample that counts every reference must give the full
+ * run's hit ratio, which is as exact a check as the others. Over
+ * randomized traces the sample is an estimate, and its hit ratio must be
+ * within SAMPLE_SIGMAS standard errors of the full run's. A 95% interval
+ * would be missed by 1 honest sample in 20, so the margin is wide enough
+ * that only a broken sampler misses it, and the traces are always
+ * SAMPLE_REFS references of fixed seeds whatever -n is, so the outcome
+ * never changes from run to run. These estimates are counted apart from
+ * the exact checks. The exit status is 1 if anything failed.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_ARGS 16
+#define CHUNK (1 << 20)
+
+// the randomized traces the sampled runs are checked on, and how many
+// standard errors a sample may be off the full run
+#define SAMPLE_REFS "1M"
+#define SAMPLE_SIGMAS 4
+
+typedef struct
+{
+  const char *options;   // for main and the model
+  const char *extra;     // for main only
+} testCase;
+
+// each text trace runs in these
+static const testCase textCases[] =
+{
+  { "", "" },
+  { "-s 64 -w 4", "" },
+  { "-s 100 -w 6 -l 32", "" },
+  { "-s 4 -w 2 -r fifo", "" },
+};
+
+// each of these gets a randomized trace of its own: every specialized
+// kernel, the generic one for other line sizes, sets that are not a power
+// of two and masked addresses, and the ways of running main that must give
+// the same results
+static const testCase randomCases[] =
+{
+  { "", "" },
+  { "-s 256 -w 1", "" },
+  { "-s 256 -w 2", "" },
+  { "-s 64 -w 4", "" },
+  { "-s 128 -w 8", "" },
+  { "-s 1K -w 16 -r fifo", "" },
+  { "-s 100 -w 6 -l 32", "" },
+  { "-s 4K -w 16 -l 128", "" },
+  { "-s 64 -w 4 -a 24", "" },
+  { "-s 1K -w 8", "-k generic" },
+  { "-s 1K -w 8", "-j 4" },
+};
+
+// sampled runs, options for both runs and the sample for the sampled one
+static const testCase textSamples[] =
+{
+  { "", "-p period=8,detail=8" },
+  { "-s 4 -w 2", "-p sets=1,period=5,detail=5" },
+};
+
+// each with a randomized trace of its own
+static const testCase randomSamples[] =
+{
+  { "-s 1K -w 8", "-p sets=8" },
+  { "", "-p sets=32" },
+  { "-s 1K -w 8", "-p period=64K,detail=8K" },
+  { "", "-p period=100K,warm=10K,detail=20K" },
+  { "-s 1K -w 8", "-p sets=4,period=64K,detail=8K" },
+  { "", "-p sets=4,period=64K,detail=8K" },
+};
+
+#define COUNT(a) (int) (sizeof (a) / sizeof (a[0]))
+
+static char dir[64];
+
+// run argv in directory 'in' with its output going to 'out' there;
+// returns its exit status, or -1
+static int run(char *const argv[], const char *in, const char *out)
+{
+  int status, fd;
+  pid_t pid;
+
+  pid = fork();
+  if (pid < 0)
+     return -1;
+  if (pid == 0)
+  {
+     if (chdir(in) != 0)
+        _exit(127);
+     fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+     if (fd < 0)
+        _exit(127);
+     dup2(fd, 1);
+     execv(argv[0], argv);
+     _exit(127);
+  }
+  if (waitpid(pid, &status, 0) != pid)
+     return -1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// split the options into argv after the program, and end it with the trace
+static void makeArgs(char **argv, char *buf, size_t size, const char *prog,
+                     const char *options, const char *extra, const char *trace)
+{
+  char *tok, *save;
+  int k = 0;
+
+  snprintf(buf, size, "%s %s", options, extra);
+  argv[k++] = (char *) prog;
+  for (tok = strtok_r(buf, " ", &save); tok != NULL && k <= MAX_ARGS;
+       tok = strtok_r(NULL, " ", &save))
+     argv[k++] = tok;
+  argv[k++] = (char *) trace;
+  argv[k] = NULL;
+}
+
+// whether two files are the same, compared a chunk at a time
+static int same(FILE *fa, FILE *fb)
+{
+  static char a[CHUNK], b[CHUNK];
+  size_t na, nb;
+
+  do
+  {
+     na = fread(a, 1, CHUNK, fa);
+     nb = fread(b, 1, CHUNK, fb);
+     if (na != nb || memcmp(a, b, na) != 0)
+        return 0;
+  } while (na > 0);
+  return 1;
+}
+
+// compare what was expected, the model's output or a full run's, with
+// what main wrote; if they differ, go over them again a line at a time for
+// the first line that does and the last 'Reference n' line before it, so
+// the snapshot it is in can be found, and write them to the report
+static int compare(const char *what, const char *expected, const char *got,
+                   char *report, size_t size)
+{
+  char a[512], b[512], where[512] = "";
+  FILE *fa, *fb;
+  long long line = 0;
+  char *pa, *pb;
+
+  fa = fopen(expected, "r");
+  fb = fopen(got, "r");
+  if (fa == NULL || fb == NULL)
+  {
+     snprintf(report, size, "    %s: missing\n", what);
+     if (fa != NULL)
+        fclose(fa);
+     if (fb != NULL)
+        fclose(fb);
+     return 1;
+  }
+  if (same(fa, fb))
+  {
+     fclose(fa);
+     fclose(fb);
+     return 0;
+  }
+
+  rewind(fa);
+  rewind(fb);
+  do
+  {
+     pa = fgets(a, sizeof (a), fa);
+     pb = fgets(b, sizeof (b), fb);
+     line++;
+     if (pa != NULL && strncmp(a, "Reference ", 10) == 0)
+        strcpy(where, a);
+  } while (pa != NULL && pb != NULL && strcmp(a, b) == 0);
+  where[strcspn(where, "\n")] = '\0';
+  snprintf(report, size, "    %s differs at line %lld%s%s\n      expected: %s      got:      %s",
+           what, line, where[0] ? ", in " : "", where,
+           pa != NULL ? a : "(end of file)\n", pb != NULL ? b : "(end of file)\n");
+  fclose(fa);
+  fclose(fb);
+  return 1;
+}
+
+static void removeAll(const char *path)
+{
+  char *argv[] = { "/bin/rm", "-rf", (char *) path, NULL };
+  run(argv, "/", "/dev/null");
+}
+
+static void label(const char *trace, const testCase *tc)
+{
+  printf("%-14s %-20s %-36s ", strrchr(trace, '/') ? strrchr(trace, '/') + 1 : trace,
+         tc->options, tc->extra);
+  fflush(stdout);
+}
+
+// the hit ratio main printed, and the half width of its interval if it
+// was sampled; returns -1 if there is none
+static int hitRatio(const char *name, double *ratio, double *width)
+{
+  char line[256];
+  FILE *fp;
+  int found = -1;
+
+  fp = fopen(name, "r");
+  if (fp == NULL)
+     return -1;
+  *width = 0;
+  while (fgets(line, sizeof (line), fp) != NULL)
+  {
+     if (sscanf(line, " Hit ratio: %lf +- %lf", ratio, width) >= 1)
+        found = 0;
+  }
+  fclose(fp);
+  return found;
+}
+
+// run main over the trace in full and sampled, in the given directory, and
+// check the full run's hit ratio is the sample's, or within SAMPLE_SIGMAS
+// standard errors of it
+static int sampleCheck(const char *mainPath, const char *trace, const testCase *tc,
+                       const char *runDir, int exact)
+{
+  char name[256], buf[256];
+  char *argv[MAX_ARGS + 3];
+  double full, sampled, width, unused;
+
+  mkdir(runDir, 0755);
+  label(trace, tc);
+  makeArgs(argv, buf, sizeof (buf), mainPath, tc->options, "", trace);
+  if (run(argv, runDir, "full.txt") != 0)
+  {
+     printf("FAILED, main did not run\n");
+     return 1;
+  }
+  makeArgs(argv, buf, sizeof (buf), mainPath, tc->options, tc->extra, trace);
+  if (run(argv, runDir, "sampled.txt") != 0)
+  {
+     printf("FAILED, main did not run sampled\n");
+     return 1;
+  }
+  snprintf(name, sizeof (name), "%s/full.txt", runDir);
+  if (hitRatio(name, &full, &unused) != 0)
+  {
+     printf("FAILED, no hit ratio\n");
+     return 1;
+  }
+  snprintf(name, sizeof (name), "%s/sampled.txt", runDir);
+  if (hitRatio(name, &sampled, &width) != 0)
+  {
+     printf("FAILED, no sampled hit ratio\n");
+     return 1;
+  }
+  // the ratios are printed to 6 places, and the width is that of a 95%
+  // interval, 1.96 standard errors
+  width = exact ? 1e-6 : width / 1.96 * SAMPLE_SIGMAS;
+  if (fabs(sampled - full) > width)
+  {
+     printf("FAILED\n    full run %f, sampled %f +- %f\n", full, sampled, width);
+     return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
+
+// run main over the trace in full, then again stopping after a few
+// references with -W, carrying on from there with -R and -W to the same
+// checkpoint, and starting from that once more; both runs from a
+// checkpoint must print the full run's stats
+static int checkpointCheck(const char *mainPath, const char *trace, const char *runDir)
+{
+  static const testCase steps[] =
+  {
+    { "", "" },
+    { "-n 10 -W ck", "" },
+    { "-R ck -W ck", "" },
+    { "-R ck", "" },
+  };
+  static const char *const outputs[] = { "full.txt", "first.txt", "rest.txt", "again.txt" };
+  char name[256], other[256], buf[256], report[2048];
+  char *argv[MAX_ARGS + 3];
+  int i;
+
+  mkdir(runDir, 0755);
+  label(trace, &steps[2]);
+  for (i = 0; i < COUNT(steps); i++)
+  {
+     makeArgs(argv, buf, sizeof (buf), mainPath, steps[i].options, "", trace);
+     if (run(argv, runDir, outputs[i]) != 0)
+     {
+        printf("FAILED, main %s did not run\n", steps[i].options);
+        return 1;
+     }
+  }
+  snprintf(name, sizeof (name), "%s/full.txt", runDir);
+  for (i = 2; i < COUNT(steps); i++)
+  {
+     snprintf(other, sizeof (other), "%s/%s", runDir, outputs[i]);
+     if (compare(outputs[i], name, other, report, sizeof (report)) != 0)
+     {
+        printf("FAILED\n%s", report);
+        return 1;
+     }
+  }
+  printf("ok\n");
+  return 0;
+}
+
+// write a randomized trace of tracegen's check kind
+static int makeTrace(const char *genPath, const char *refs, int n, char *trace, size_t size)
+{
+  char count[32], seed[16];
+  char *gen[6];
+
+  snprintf(trace, size, "%s/check-%d.bin", dir, n);
+  snprintf(count, sizeof (count), "%s", refs);
+  snprintf(seed, sizeof (seed), "%d", n);
+  gen[0] = (char *) genPath;
+  gen[1] = "check";
+  gen[2] = count;
+  gen[3] = trace;
+  gen[4] = seed;
+  gen[5] = NULL;
+  if (run(gen, dir, "/dev/null") != 0)
+  {
+     fprintf(stderr, "cannot generate %s\n", trace);
+     return -1;
+  }
+  return 0;
+}
+
+// run one trace through the model and main, in directories model and main
+// of the given one, and compare what they wrote
+static int check(const char *mainPath, const char *modelPath, const char *trace,
+                 const testCase *tc, const char *runDir)
+{
+  char modelDir[128], mainDir[128], name[256], other[256];
+  char buf[256], report[2048];
+  char *argv[MAX_ARGS + 3];
+  int failed;
+
+  snprintf(modelDir, sizeof (modelDir), "%s/model", runDir);
+  snprintf(mainDir, sizeof (mainDir), "%s/main", runDir);
+  mkdir(runDir, 0755);
+  mkdir(modelDir, 0755);
+  mkdir(mainDir, 0755);
+
+  label(trace, tc);
+  makeArgs(argv, buf, sizeof (buf), modelPath, tc->options, "", trace);
+  if (run(argv, modelDir, "stats.txt") != 0)
+  {
+     printf("FAILED, the model did not run\n");
+     return 1;
+  }
+  makeArgs(argv, buf, sizeof (buf), mainPath, tc->options, tc->extra, trace);
+  if (run(argv, mainDir, "stats.txt") != 0)
+  {
+     printf("FAILED, main did not run\n");
+     return 1;
+  }
+
+  snprintf(name, sizeof (name), "%s/stats.txt", modelDir);
+  snprintf(other, sizeof (other), "%s/stats.txt", mainDir);
+  failed = compare("stats", name, other, report, sizeof (report));
+  if (!failed)
+  {
+     snprintf(name, sizeof (name), "%s/display.txt", modelDir);
+     snprintf(other, sizeof (other), "%s/display.txt", mainDir);
+     failed = compare("display.txt", name, other, report, sizeof (report));
+  }
+  if (failed)
+     printf("FAILED\n%s", report);
+  else
+     printf("ok\n");
+  return failed;
+}
+
+int main(int argc, char *argv[])
+{
+  char mainPath[4096], modelPath[4096], genPath[4096], trace[4096];
+  char runDir[128];
+  const char *refs = "1M";
+  int keep = 0, failed = 0, checks = 0, estimates = 0, missed = 0;
+  int opt, i, err;
+  size_t j;
+  glob_t g;
+
+  while ((opt = getopt(argc, argv, "n:k")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n':
+        refs = optarg;
+        break;
+      case 'k':
+        keep = 1;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n references] [-k]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  // the children run in their own directories
+  if (realpath("main", mainPath) == NULL || realpath("model", modelPath) == NULL ||
+      realpath("tracegen", genPath) == NULL)
+  {
+     fprintf(stderr, "run %s where main, model and tracegen are built\n", argv[0]);
+     return 1;
+  }
+  strcpy(dir, "/tmp/regress-XXXXXX");
+  if (mkdtemp(dir) == NULL)
+  {
+     fprintf(stderr, "cannot make a directory in /tmp\n");
+     return 1;
+  }
+
+  // the text traces, whose outputs original.c's testout files were made from
+  if (glob("testfile.din", 0, NULL, &g) != 0 ||
+      glob("testcases/test.txt", GLOB_APPEND, NULL, &g) != 0 ||
+      glob("testcases/test[0-9]*.txt", GLOB_APPEND, NULL, &g) != 0)
+  {
+     fprintf(stderr, "testfile.din or testcases/ is missing\n");
+     return 1;
+  }
+  for (j = 0; j < g.gl_pathc; j++)
+  {
+     if (realpath(g.gl_pathv[j], trace) == NULL)
+        continue;
+     for (i = 0; i < COUNT(textCases); i++)
+     {
+        snprintf(runDir, sizeof (runDir), "%s/%d", dir, ++checks);
+        err = check(mainPath, modelPath, trace, &textCases[i], runDir);
+        if (!err && !keep)
+           removeAll(runDir);
+        failed += err;
+     }
+     snprintf(runDir, sizeof (runDir), "%s/%d", dir, ++checks);
+     err = checkpointCheck(mainPath, trace, runDir);
+     if (!err && !keep)
+        removeAll(runDir);
+     failed += err;
+     for (i = 0; i < COUNT(textSamples); i++)
+     {
+        snprintf(runDir, sizeof (runDir), "%s/%d", dir, ++checks);
+        err = sampleCheck(mainPath, trace, &textSamples[i], runDir, 1);
+        if (!err && !keep)
+           removeAll(runDir);
+        failed += err;
+     }
+  }
+  globfree(&g);
+
+  // a randomized trace for each case, of a seed of its own
+  for (i = 0; i < COUNT(randomCases); i++)
+  {
+     if (makeTrace(genPath, refs, i + 1, trace, sizeof (trace)) != 0)
+     {
+        failed++;
+        break;
+     }
+     snprintf(runDir, sizeof (runDir), "%s/%d", dir, ++checks);
+     err = check(mainPath, modelPath, trace, &randomCases[i], runDir);
+     if (!err && !keep)
+     {
+        removeAll(runDir);
+        unlink(trace);
+     }
+     failed += err;
+  }
+  // the estimates, apart from the checks above
+  for (i = 0; i < COUNT(randomSamples); i++)
+  {
+     if (makeTrace(genPath, SAMPLE_REFS, 101 + i, trace, sizeof (trace)) != 0)
+     {
+        missed++;
+        break;
+     }
+     estimates++;
+     snprintf(runDir, sizeof (runDir), "%s/%d", dir, checks + estimates);
+     err = sampleCheck(mainPath, trace, &randomSamples[i], runDir, 0);
+     if (!err && !keep)
+     {
+        removeAll(runDir);
+        unlink(trace);
+     }
+     missed += err;
+  }
+
+  if (failed)
+     printf("%d of %d checks FAILED, the runs are in %s\n", failed, checks, dir);
+  else
+     printf("all %d checks passed\n", checks);
+  if (missed)
+     printf("%d of %d sampled estimates FAILED, more than %d standard errors off, the runs "
+            "are in %s\n", missed, estimates, SAMPLE_SIGMAS, dir);
+  else
+     printf("all %d sampled estimates within %d standard errors\n", estimates,
+            SAMPLE_SIGMAS);
+  if (keep)
+     printf("the runs are kept in %s\n", dir);
+  else if (!failed && !missed)
+     rmdir(dir);
+  return failed || missed ? 1 : 0;
+}
@@ -0,0 +1,32 @@
+/* replace.c
+ *
+ * Names of the replacement policies in replace.h, for the command line
+ * and the stats.
+ *
+ */
+
+#include <string.h>
+
+#include "replace.h"
+
+static const char *const names[REPL_POLICIES] =
+{
+  "lru", "plru", "srrip", "brrip", "drrip", "fifo", "random"
+};
+
+// returns the REPL_* number of the named policy, or -1
+int replLookup(const char *name)
+{
+  int policy;
+  for (policy = 0; policy < REPL_POLICIES; policy++)
+  {
+     if (strcmp(name, names[policy]) == 0)
+        return policy;
+  }
+  return -1;
+}
+
+const char *replName(int policy)
+{
+  return names[policy];
+}
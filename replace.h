@@ -0,0 +1,306 @@
+/* replace.h
+ *
+ * Replacement policies for the cache sets.
+ *
+ * Every set keeps its replacement state in one 64-bit word. A policy is
+ * a handful of static inline functions over that word, all taking the
+ * policy as their first argument, so a caller that passes a constant
+ * policy gets the policy's code inlined with the others folded away.
+ *
+ *   replInit    the state of a set after a reset
+ *   replVictim  the way to evict from a set
+ *   replHit     a way was referenced and found
+ *   replFill    a way was just filled after a miss
+ *   replRank    a small number per way for cacheDisplay()'s LRU column
+ *
+ * 'ways' is the number of ways in the set, at most 16.
+ *
+ */
+
+#ifndef REPLACE_H
+#define REPLACE_H
+
+#include <stdint.h>
+
+#define REPL_LRU 0      // true LRU, ways kept in order of use
+#define REPL_PLRU 1     // tree pseudo-LRU
+#define REPL_SRRIP 2    // static re-reference interval prediction
+#define REPL_BRRIP 3    // bimodal RRIP, mostly inserts at distant
+#define REPL_DRRIP 4    // SRRIP or BRRIP, chosen by set dueling
+#define REPL_FIFO 5     // evict in the order ways were filled
+#define REPL_RANDOM 6   // evict a pseudo-random way
+#define REPL_POLICIES 7
+
+// DRRIP dedicates one set in every DUEL_PERIOD to each of SRRIP and BRRIP
+// and lets the rest follow whichever of the two is missing less, as
+// tracked by a saturating PSEL counter
+#define DUEL_PERIOD 32
+#define PSEL_MAX 1023
+
+// BRRIP inserts at 'long' instead of 'distant' once in BRRIP_LONG fills
+#define BRRIP_LONG 32
+
+int replLookup(const char *name);
+const char *replName(int policy);
+
+// order: the LRU and FIFO state, a list of ways 4 bits each
+// the nibble at bit 4r is the way at rank r, rank 0 is the next victim
+
+static inline int orderRank(uint64_t order, int way)
+{
+  uint64_t x = order ^ (0x1111111111111111ull * way);
+  uint64_t zero = ~(((x & 0x7777777777777777ull) + 0x7777777777777777ull) | x)
+                  & 0x8888888888888888ull;
+  return __builtin_ctzll(zero) >> 2;
+}
+
+// cut the way out of the order and put it on top, rank ways - 1
+static inline uint64_t orderPromote(uint64_t order, int way, int ways)
+{
+  int rank = orderRank(order, way);
+  if (rank == ways - 1)
+     return order;
+  uint64_t below = order & ((1ull << (4 * rank)) - 1);
+  uint64_t above = (order >> (4 * (rank + 1))) << (4 * rank);
+  return ((below | above) & ((1ull << (4 * (ways - 1))) - 1))
+         | ((uint64_t) way << (4 * (ways - 1)));
+}
+
+// tree: the PLRU state, one bit per inner node of a binary tree over the
+// ways stored heap-style (node 1 is the root, node k has children 2k and
+// 2k+1); a clear bit points left toward the next victim
+// a set whose ways are not a power of two uses the next larger tree and
+// never walks into a subtree that has no ways
+
+static inline int treeLevels(int ways)
+{
+  int levels = 0;
+  while ((1 << levels) < ways)
+     levels++;
+  return levels;
+}
+
+static inline int treeVictim(uint64_t tree, int ways)
+{
+  int levels = treeLevels(ways);
+  int node = 1, level;
+  for (level = 0; level < levels; level++)
+  {
+     int right = (tree >> node) & 1;
+     // the first way under the right child
+     int first = ((2 * node + 1) << (levels - level - 1)) - (1 << levels);
+     if (first >= ways)
+        right = 0;
+     node = 2 * node + right;
+  }
+  return node - (1 << levels);
+}
+
+// point every node on the way's path away from it
+static inline uint64_t treeTouch(uint64_t tree, int way, int ways)
+{
+  int levels = treeLevels(ways);
+  int node = way + (1 << levels);
+  while (node > 1)
+  {
+     int parent = node >> 1;
+     if (node & 1)
+        tree &= ~(1ull << parent);
+     else
+        tree |= 1ull << parent;
+     node = parent;
+  }
+  return tree;
+}
+
+// the number of nodes on the way's path pointing away from it, leaving out
+// nodes whose other side has no ways: 0 for the next victim
+static inline int treeRank(uint64_t tree, int way, int ways)
+{
+  int levels = treeLevels(ways);
+  int node = way + (1 << levels);
+  int depth = levels;
+  int rank = 0;
+  while (node > 1)
+  {
+     int parent = node >> 1;
+     int sibling = node ^ 1;
+     if ((sibling << (levels - depth)) - (1 << levels) < ways)
+        rank += ((tree >> parent) & 1) == (uint64_t) (node & 1 ? 0 : 1);
+     node = parent;
+     depth--;
+  }
+  return rank;
+}
+
+// rrpv: the RRIP state, a 2-bit re-reference prediction value per way in
+// the low 32 bits (way w at bit 2w, 3 = distant, the next victim)
+// the high 32 bits hold the xorshift state BRRIP draws from
+
+#define RRPV_DISTANT 3
+#define RRPV_LONG 2
+
+static inline uint64_t rrpvSet(uint64_t state, int way, int rrpv)
+{
+  return (state & ~(3ull << (2 * way))) | ((uint64_t) rrpv << (2 * way));
+}
+
+static inline int rrpvVictim(uint64_t *state, int ways)
+{
+  uint32_t waybits = 0x55555555u >> (32 - 2 * ways);
+  for (;;)
+  {
+     uint32_t r = (uint32_t) *state;
+     uint32_t distant = r & (r >> 1) & waybits;
+     if (distant)
+        return __builtin_ctz(distant) >> 1;
+     // nothing is distant yet, age every way by one
+     *state += waybits;
+  }
+}
+
+// per-set pseudo-random numbers, so a set's choices do not depend on
+// what happened in other sets
+static inline uint32_t xorshift(uint32_t x)
+{
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+static inline uint32_t seedFor(int index)
+{
+  return ((uint32_t) index * 2654435761u) | 1;
+}
+
+// the policy a DRRIP set uses: leaders use their own, followers ask PSEL
+static inline int duelPolicy(int index, int psel)
+{
+  switch (index % DUEL_PERIOD)
+  {
+    case 0:
+      return REPL_SRRIP;
+    case 1:
+      return REPL_BRRIP;
+  }
+  return psel > PSEL_MAX / 2 ? REPL_BRRIP : REPL_SRRIP;
+}
+
+static inline uint64_t replInit(int policy, int index)
+{
+  switch (policy)
+  {
+    case REPL_LRU:
+    case REPL_FIFO:
+      return 0xfedcba9876543210ull;
+    case REPL_PLRU:
+      return 0;
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+    case REPL_DRRIP:
+      return ((uint64_t) seedFor(index) << 32) | 0xffffffffu;
+    case REPL_RANDOM:
+      return seedFor(index);
+  }
+  return 0;
+}
+
+static inline int replVictim(int policy, uint64_t *state, int ways)
+{
+  switch (policy)
+  {
+    case REPL_LRU:
+    case REPL_FIFO:
+      return *state & 15;
+    case REPL_PLRU:
+      return treeVictim(*state, ways);
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+    case REPL_DRRIP:
+      return rrpvVictim(state, ways);
+    case REPL_RANDOM:
+      *state = xorshift((uint32_t) *state);
+      return (uint32_t) *state % ways;
+  }
+  return 0;
+}
+
+static inline void replHit(int policy, uint64_t *state, int way, int ways)
+{
+  switch (policy)
+  {
+    case REPL_LRU:
+      *state = orderPromote(*state, way, ways);
+      break;
+    case REPL_PLRU:
+      *state = treeTouch(*state, way, ways);
+      break;
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+    case REPL_DRRIP:
+      *state = rrpvSet(*state, way, 0);
+      break;
+  }
+}
+
+// a fill is always a miss, which is what DRRIP's leader sets count in psel
+static inline void replFill(int policy, uint64_t *state, int way, int ways,
+                            int index, int *psel)
+{
+  uint32_t x;
+
+  if (policy == REPL_DRRIP)
+  {
+     switch (index % DUEL_PERIOD)
+     {
+       case 0:
+         if (*psel < PSEL_MAX)
+            (*psel)++;
+         break;
+       case 1:
+         if (*psel > 0)
+            (*psel)--;
+         break;
+     }
+     policy = duelPolicy(index, *psel);
+  }
+
+  switch (policy)
+  {
+    case REPL_LRU:
+    case REPL_FIFO:
+      *state = orderPromote(*state, way, ways);
+      break;
+    case REPL_PLRU:
+      *state = treeTouch(*state, way, ways);
+      break;
+    case REPL_SRRIP:
+      *state = rrpvSet(*state, way, RRPV_LONG);
+      break;
+    case REPL_BRRIP:
+      x = xorshift(*state >> 32);
+      *state = ((uint64_t) x << 32) | (uint32_t) *state;
+      *state = rrpvSet(*state, way, x % BRRIP_LONG ? RRPV_DISTANT : RRPV_LONG);
+      break;
+  }
+}
+
+static inline int replRank(int policy, uint64_t state, int way, int ways)
+{
+  switch (policy)
+  {
+    case REPL_LRU:
+    case REPL_FIFO:
+      return orderRank(state, way);
+    case REPL_PLRU:
+      return treeRank(state, way, ways);
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+    case REPL_DRRIP:
+      return (state >> (2 * way)) & 3;
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,314 @@
+/* sample.c
+ *
+ * The sampled run, see sample.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sample.h"
+
+// references collected for a group before they are run
+#define SAMPLE_BUFFER 256
+
+// each group of sampled sets is run on a copy of the cache that shares its
+// sets but keeps its own stats; what they count in the detailed intervals
+// adds up to the group's cluster
+typedef struct
+{
+  cache c;
+  int count;
+  traceRecord buf[SAMPLE_BUFFER];
+  sampleCluster total;
+} sampleGroup;
+
+// read a comma separated list of key=value settings, e.g. "sets=32" or
+// "period=10M,warm=100K,detail=1M"
+int sampleConfigSpec(sampleConfig *sc, const char *spec)
+{
+  char buf[256];
+  char *item, *value, *save;
+  uint64_t n;
+
+  if (strlen(spec) >= sizeof (buf))
+     return -1;
+  strcpy(buf, spec);
+  for (item = strtok_r(buf, ",", &save); item != NULL;
+       item = strtok_r(NULL, ",", &save))
+  {
+     value = strchr(item, '=');
+     if (value == NULL)
+        return -1;
+     *value++ = '\0';
+     if (parseSize(value, &n) != 0)
+        return -1;
+     if (strcmp(item, "sets") == 0 && n >= 1 && n <= 0xffffffffu)
+        sc->sets = n;
+     else if (strcmp(item, "period") == 0)
+        sc->period = n;
+     else if (strcmp(item, "warm") == 0)
+        sc->warm = n;
+     else if (strcmp(item, "detail") == 0)
+        sc->detail = n;
+     else
+        return -1;
+  }
+  if (sc->period > 0 && (sc->detail == 0 || sc->warm + sc->detail > sc->period))
+     return -1;
+  return 0;
+}
+
+// spread the indices so that every 1 in n of them is a fair sample
+static uint32_t setHash(uint32_t index)
+{
+  index ^= index >> 16;
+  index *= 0x7feb352d;
+  index ^= index >> 15;
+  index *= 0x846ca68b;
+  index ^= index >> 16;
+  return index;
+}
+
+static void flush(sampleGroup *g)
+{
+  cacheRun(&g->c, g->buf, g->count);
+  g->count = 0;
+}
+
+static void flushAll(sampleGroup *groups, int n)
+{
+  int i;
+  for (i = 0; i < n; i++)
+     flush(&groups[i]);
+}
+
+// the groups' copies have to follow a reset into the new epoch
+static void syncReset(const cache *c, sampleGroup *groups, int n)
+{
+  int i;
+  for (i = 0; i < n; i++)
+  {
+     groups[i].c.epoch = c->epoch;
+     groups[i].c.psel = c->psel;
+  }
+}
+
+static int addCluster(sampleResult *r, long long refs, long long hits, long long misses)
+{
+  if (r->clusterCount == r->clusterSize)
+  {
+     int size = r->clusterSize ? 2 * r->clusterSize : 64;
+     sampleCluster *p = realloc(r->clusters, size * sizeof (sampleCluster));
+     if (p == NULL)
+     {
+        fprintf(stderr, "cannot allocate the sample\n");
+        return -1;
+     }
+     r->clusters = p;
+     r->clusterSize = size;
+  }
+  r->clusters[r->clusterCount].refs = refs;
+  r->clusters[r->clusterCount].hits = hits;
+  r->clusters[r->clusterCount].misses = misses;
+  r->clusterCount++;
+  r->sampled += refs;
+  return 0;
+}
+
+// end a detailed interval: without set sampling the interval is a
+// cluster, with it the counts go to each group's cluster, as which sets
+// were picked matters more than which intervals
+static int endInterval(sampleResult *r, sampleGroup *groups, int n)
+{
+  long long refs = 0, hits = 0, misses = 0;
+  int i;
+
+  flushAll(groups, n);
+  for (i = 0; i < n; i++)
+  {
+     groups[i].total.refs += groups[i].c.stats.refCount;
+     groups[i].total.hits += groups[i].c.stats.hitCount;
+     groups[i].total.misses += groups[i].c.stats.missCount;
+     refs += groups[i].c.stats.refCount;
+     hits += groups[i].c.stats.hitCount;
+     misses += groups[i].c.stats.missCount;
+     memset(&groups[i].c.stats, 0, sizeof (cacheStats));
+  }
+  return n == 1 && refs > 0 ? addCluster(r, refs, hits, misses) : 0;
+}
+
+// run the trace through the sampled part of the cache
+// returns -1, after saying why, if the sample cannot be taken
+int sampleRun(cache *c, trace *t, const sampleConfig *sc, sampleResult *r)
+{
+  sampleGroup *groups;
+  int n = sc->sets > 1 ? SAMPLE_GROUPS : 1;
+  uint64_t skipLen = sc->period ? sc->period - sc->warm - sc->detail : 0;
+  uint64_t pos = 0, off = 0;
+  const traceRecord *block;
+  size_t count, i;
+  uint32_t index, tag, h;
+  int g, detail = sc->period == 0, err = 0;
+
+  memset(r, 0, sizeof (sampleResult));
+  if (c->config.policy == REPL_DRRIP && sc->sets > 1)
+  {
+     fprintf(stderr, "drrip shares one PSEL counter between all sets and "
+                     "cannot be set sampled\n");
+     return -1;
+  }
+  groups = calloc(n, sizeof (sampleGroup));
+  if (groups == NULL)
+  {
+     fprintf(stderr, "cannot allocate the sample\n");
+     return -1;
+  }
+  for (g = 0; g < n; g++)
+  {
+     groups[g].c = *c;
+     memset(&groups[g].c.stats, 0, sizeof (cacheStats));
+  }
+
+  while (!err && (count = traceNext(t, &block)) > 0)
+  {
+     for (i = 0; i < count && !err; i++, pos++)
+     {
+        const traceRecord *rec = &block[i];
+
+        switch (rec->n)
+        {
+          case 0:
+          case 2:
+          case 4:
+          case 6:
+            r->readCount++;
+            break;
+          case 1:
+          case 5:
+            r->writeCount++;
+            break;
+          case 8:
+          case 9:
+            r->barriers++;
+            break;
+        }
+
+        // where this reference falls in its period
+        if (sc->period)
+        {
+           if (off == 0 && detail)
+           {
+              // the previous reference ended a detailed interval
+              err = endInterval(r, groups, n) != 0;
+              detail = 0;
+           }
+           if (off == skipLen + sc->warm)
+           {
+              // the detailed interval starts, forget what warming counted
+              flushAll(groups, n);
+              for (g = 0; g < n; g++)
+                 memset(&groups[g].c.stats, 0, sizeof (cacheStats));
+              detail = 1;
+           }
+           if (++off == sc->period)
+              off = 0;
+           // a fast forwarded reference goes through the tags and the
+           // replacement state like any other, so the next interval starts
+           // from the cache a full run would have; what it counts is
+           // thrown away when the detailed interval starts
+        }
+
+        if (rec->n == 8 || rec->n == 9)
+        {
+           // run on the whole cache, numbered as in a full run
+           flushAll(groups, n);
+           c->stats.refCount = pos;
+           cacheRun(c, rec, 1);
+           syncReset(c, groups, n);
+           continue;
+        }
+
+        splitAddress(c, rec->addr, &index, &tag, 0);
+        h = setHash(index);
+        if (h % sc->sets != 0)
+           continue;
+        g = n > 1 ? (h / sc->sets) % n : 0;
+        groups[g].buf[groups[g].count++] = *rec;
+        if (groups[g].count == SAMPLE_BUFFER)
+           flush(&groups[g]);
+     }
+  }
+  r->refCount = pos;
+
+  if (!err && detail)
+     err = endInterval(r, groups, n) != 0;
+  for (g = 0; g < n && n > 1 && !err; g++)
+  {
+     if (groups[g].total.refs > 0)
+        err = addCluster(r, groups[g].total.refs, groups[g].total.hits,
+                         groups[g].total.misses) != 0;
+  }
+  free(groups);
+  return err ? -1 : 0;
+}
+
+// the ratio y / x over every cluster, and the standard error of that
+// ratio estimate from the clusters' spread around it
+static double ratio(const sampleResult *r, int misses, double *se)
+{
+  double x = 0, y = 0, sum = 0, mean, d;
+  int i, m = r->clusterCount;
+
+  for (i = 0; i < m; i++)
+  {
+     x += r->clusters[i].refs;
+     y += misses ? r->clusters[i].misses : r->clusters[i].hits;
+  }
+  if (x == 0)
+  {
+     *se = 0;
+     return 0;
+  }
+  for (i = 0; i < m; i++)
+  {
+     d = (misses ? r->clusters[i].misses : r->clusters[i].hits) - y / x * r->clusters[i].refs;
+     sum += d * d;
+  }
+  mean = x / m;
+  *se = m > 1 ? sqrt(sum / (m * (m - 1.0))) / mean : 0;
+  return y / x;
+}
+
+void samplePrint(const sampleConfig *sc, const sampleResult *r)
+{
+  // resets and displays are neither hits nor misses, and are not sampled
+  double scale = r->refCount ? (double) (r->refCount - r->barriers) / r->refCount : 0;
+  double hitSE, missSE;
+  double hitRatio = ratio(r, 0, &hitSE) * scale;
+  double missRatio = ratio(r, 1, &missSE) * scale;
+
+  printf(" Total References: %lld\n Reads: %lld\n Writes: %lld\n Hits: %.0f (estimated)\n"
+         " Misses %.0f (estimated)\n Hit ratio: %f +- %f (95%% confidence)\n"
+         " Miss ratio: %f +- %f (95%% confidence)\n"
+         " Sampled: %lld references (%.2f%%) in %d clusters",
+         r->refCount, r->readCount, r->writeCount, hitRatio * r->refCount,
+         missRatio * r->refCount, hitRatio, 1.96 * hitSE * scale, missRatio,
+         1.96 * missSE * scale, r->sampled,
+         r->refCount ? 100.0 * r->sampled / r->refCount : 0.0, r->clusterCount);
+  if (sc->sets > 1)
+     printf(", 1 in %u sets", sc->sets);
+  if (sc->period)
+     printf(", %llu of every %llu references after %llu to warm up",
+            (unsigned long long) sc->detail, (unsigned long long) sc->period,
+            (unsigned long long) sc->warm);
+  printf("\n---------------------------------------------------------------------\n");
+}
+
+void sampleFree(sampleResult *r)
+{
+  free(r->clusters);
+  memset(r, 0, sizeof (sampleResult));
+}
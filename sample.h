@@ -0,0 +1,68 @@
+/* sample.h
+ *
+ * Estimating a cache's hit ratio from part of the trace.
+ *
+ * Set sampling simulates only the references to 1 in every 'sets' sets,
+ * picked by a hash of the index. Time sampling splits the trace into
+ * periods of 'period' references and simulates only the end of each:
+ * the rest of the period is fast forwarded and 'warm' references warm
+ * the cache, both run through the tags and replacement state without
+ * being counted, then 'detail' references are measured. The cache is
+ * therefore always the one a full run would have, and only the counting
+ * is sampled. The two can be combined.
+ *
+ * The hit and miss ratios of the simulated references are taken as those
+ * of the whole trace. Their 95% confidence interval comes from the spread
+ * between clusters: SAMPLE_GROUPS groups of the sampled sets when set
+ * sampling, with or without time sampling, otherwise the detailed
+ * intervals.
+ *
+ * Reads and writes depend only on the ops and are counted exactly.
+ *
+ */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdint.h>
+
+#include "trace.h"
+#include "cache.h"
+
+// the sampled sets are split into this many groups to measure the spread
+#define SAMPLE_GROUPS 32
+
+typedef struct
+{
+  unsigned sets;       // simulate 1 in this many sets, 1 for all
+  uint64_t period;     // 0 for no time sampling
+  uint64_t warm;
+  uint64_t detail;
+} sampleConfig;
+
+// one cluster's counts
+typedef struct
+{
+  long long refs;
+  long long hits;
+  long long misses;
+} sampleCluster;
+
+typedef struct
+{
+  long long refCount;     // the whole trace
+  long long readCount;
+  long long writeCount;
+  long long barriers;     // resets and displays, which are not sampled
+  long long sampled;      // references simulated and counted
+  sampleCluster *clusters;
+  int clusterCount;
+  int clusterSize;
+} sampleResult;
+
+int sampleConfigSpec(sampleConfig *sc, const char *spec);
+int sampleRun(cache *c, trace *t, const sampleConfig *sc, sampleResult *r);
+void samplePrint(const sampleConfig *sc, const sampleResult *r);
+void sampleFree(sampleResult *r);
+
+#endif
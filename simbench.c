@@ -0,0 +1,116 @@
+/* simbench.c
+ *
+ * Measures how fast the simulator runs references through the cache,
+ * comparing the kernels specialized for 1, 2, 4, 8 and 16 ways of 64-byte
+ * lines against the generic kernel on the same geometry.
+ *
+ * usage: simbench [references]
+ *
+ * The references are generated in memory so trace reading is not timed:
+ * mostly reads, the rest writes and fetches, 7 in 8 of them to a hot
+ * region of 256 KB and the rest scattered over 64 MB, so that both hits
+ * and misses are timed. The hit ratio of each case is printed with it.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+
+#define DEFAULT_REFS 16000000
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t next(uint32_t x)
+{
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+static void generate(traceRecord *refs, size_t count)
+{
+  uint32_t x = 2463534242u;
+  int hot;
+  size_t i;
+
+  memset(refs, 0, count * sizeof (traceRecord));
+  for (i = 0; i < count; i++)
+  {
+     x = next(x);
+     refs[i].n = (x >> 28) < 10 ? 0 : (x >> 28) < 14 ? 1 : 2;
+     hot = (x & 7) != 0;
+     // the address from a fresh draw, so it has nothing to do with the op
+     x = next(x);
+     refs[i].addr = hot ? x & 0x3ffff : x & 0x3ffffff;
+  }
+}
+
+// run the references through one cache and return M refs/s, and the
+// hit ratio it got
+static double measure(cacheConfig *cfg, const traceRecord *refs, size_t count,
+                      unsigned *kernelWays, double *hitRatio)
+{
+  cache c;
+  double start, elapsed;
+  size_t done;
+
+  if (cacheCreate(&c, cfg, "/dev/null") != 0)
+     exit(1);
+  start = now();
+  for (done = 0; done < count; done += TRACE_BLOCK)
+     cacheRun(&c, refs + done, count - done < TRACE_BLOCK ? count - done : TRACE_BLOCK);
+  elapsed = now() - start;
+  *kernelWays = c.kernelWays;
+  *hitRatio = (double) c.stats.hitCount / c.stats.refCount;
+  cacheFree(&c);
+  return count / elapsed / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+  static const int policies[] = { REPL_LRU, REPL_PLRU, REPL_SRRIP };
+  size_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_REFS;
+  traceRecord *refs = malloc(count * sizeof (traceRecord));
+  cacheConfig cfg;
+  unsigned ways, kw;
+  size_t p;
+  double generic, special, hits;
+
+  if (refs == NULL)
+  {
+     fprintf(stderr, "cannot allocate %zu references\n", count);
+     return 1;
+  }
+  tagMatchInit();
+  generate(refs, count);
+
+  printf("%zu references, 16K sets of 64-byte lines, M refs/s\n", count);
+  printf("policy  ways   generic  specialized  speedup  hit ratio\n");
+  for (p = 0; p < sizeof (policies) / sizeof (policies[0]); p++)
+  {
+     for (ways = 1; ways <= MAXWAYS; ways *= 2)
+     {
+        cacheDefaults(&cfg);
+        cfg.ways = ways;
+        cfg.policy = policies[p];
+        cfg.generic = 1;
+        generic = measure(&cfg, refs, count, &kw, &hits);
+        cfg.generic = 0;
+        special = measure(&cfg, refs, count, &kw, &hits);
+        printf("%-7s %4u %9.1f %12.1f %7.2fx %10.4f%s\n", replName(policies[p]), ways,
+               generic, special, special / generic, hits, kw ? "" : "  (no kernel)");
+     }
+  }
+  free(refs);
+  return 0;
+}
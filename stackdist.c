@@ -0,0 +1,428 @@
+/* stackdist.c
+ *
+ * The one pass stack distance engine, see stackdist.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stackdist.h"
+
+#define STACK_NONE 0xffffffffu
+
+// a set is compacted when its slots run out, so it needs room for twice
+// the marks it can hold
+#define STACK_MINSLOTS 16
+
+// Fenwick tree over a set's slots, slots are 0-based and the tree 1-based
+
+static void treeAdd(stackSet *s, uint32_t slot, int delta)
+{
+  uint32_t i;
+  for (i = slot + 1; i <= s->size; i += i & -i)
+     s->tree[i] += delta;
+}
+
+// the marks at slots 0 .. slot - 1
+static uint32_t treeCount(const stackSet *s, uint32_t slot)
+{
+  uint32_t n = 0, i;
+  for (i = slot; i > 0; i -= i & -i)
+     n += s->tree[i];
+  return n;
+}
+
+// the lowest marked slot, the least recently referenced block of the set
+static uint32_t treeOldest(const stackSet *s)
+{
+  uint32_t pos = 0, step = 1;
+  while (step * 2 <= s->size)
+     step *= 2;
+  for (; step > 0; step >>= 1)
+  {
+     if (pos + step <= s->size && s->tree[pos + step] == 0)
+        pos += step;
+  }
+  return pos;
+}
+
+// move the marks of a set down to slots 0 .. blocks - 1, keeping their
+// order, and rebuild its tree; the first call allocates the set
+static int compact(stackDist *sd, stackSet *s, unsigned level)
+{
+  uint32_t i, j, k = 0;
+
+  if (s->tree == NULL)
+  {
+     s->size = 2 * sd->ways < STACK_MINSLOTS ? STACK_MINSLOTS : 2 * sd->ways;
+     // one allocation, the owners right after the tree
+     s->tree = calloc(2 * s->size + 1, sizeof (uint32_t));
+     if (s->tree == NULL)
+     {
+        fprintf(stderr, "cannot allocate the stack of a set\n");
+        return -1;
+     }
+     s->owner = s->tree + s->size + 1;
+     return 0;
+  }
+
+  for (i = 0; i < s->used; i++)
+  {
+     uint32_t e = s->owner[i];
+     if (e == STACK_NONE)
+        continue;
+     s->owner[k] = e;
+     sd->entry[e * sd->entryWords + 2 + level] = k;
+     k++;
+  }
+  s->used = k;
+
+  // every slot below k is marked, build the tree in linear time
+  memset(s->tree, 0, (s->size + 1) * sizeof (uint32_t));
+  for (i = 1; i <= k; i++)
+     s->tree[i] = 1;
+  for (i = 1; i <= s->size; i++)
+  {
+     j = i + (i & -i);
+     if (j <= s->size)
+        s->tree[j] += s->tree[i];
+  }
+  return 0;
+}
+
+// the hash of block numbers to entries, linear probing
+
+static uint32_t hashOf(const stackDist *sd, uint32_t block)
+{
+  return (block * 2654435761u) & (sd->hashSize - 1);
+}
+
+static uint32_t lookup(const stackDist *sd, uint32_t block)
+{
+  uint32_t h = hashOf(sd, block);
+  while (sd->hashKey[h] != 0)
+  {
+     if (sd->hashKey[h] == block + 1)
+        return sd->hashEntry[h];
+     h = (h + 1) & (sd->hashSize - 1);
+  }
+  return STACK_NONE;
+}
+
+static void hashPut(stackDist *sd, uint32_t block, uint32_t e)
+{
+  uint32_t h = hashOf(sd, block);
+  while (sd->hashKey[h] != 0)
+     h = (h + 1) & (sd->hashSize - 1);
+  sd->hashKey[h] = block + 1;
+  sd->hashEntry[h] = e;
+}
+
+// take a block out of the hash, moving later blocks of its run back so
+// that no lookup stops early at the hole
+static void hashRemove(stackDist *sd, uint32_t block)
+{
+  uint32_t mask = sd->hashSize - 1;
+  uint32_t h = hashOf(sd, block), next, home;
+
+  while (sd->hashKey[h] != block + 1)
+     h = (h + 1) & mask;
+  for (next = (h + 1) & mask; sd->hashKey[next] != 0; next = (next + 1) & mask)
+  {
+     home = hashOf(sd, sd->hashKey[next] - 1);
+     // the block at next may fill the hole if its home is not after the hole
+     if (((next - home) & mask) >= ((next - h) & mask))
+     {
+        sd->hashKey[h] = sd->hashKey[next];
+        sd->hashEntry[h] = sd->hashEntry[next];
+        h = next;
+     }
+  }
+  sd->hashKey[h] = 0;
+}
+
+static int hashGrow(stackDist *sd)
+{
+  uint32_t *oldKey = sd->hashKey, *oldEntry = sd->hashEntry;
+  uint32_t oldSize = sd->hashSize, i;
+
+  sd->hashSize = oldSize ? 2 * oldSize : 1024;
+  sd->hashKey = calloc(sd->hashSize, sizeof (uint32_t));
+  sd->hashEntry = malloc(sd->hashSize * sizeof (uint32_t));
+  if (sd->hashKey == NULL || sd->hashEntry == NULL)
+  {
+     fprintf(stderr, "cannot allocate the block hash\n");
+     return -1;
+  }
+  for (i = 0; i < oldSize; i++)
+  {
+     if (oldKey[i] != 0)
+        hashPut(sd, oldKey[i] - 1, oldEntry[i]);
+  }
+  free(oldKey);
+  free(oldEntry);
+  return 0;
+}
+
+// a new entry for a block, holding no marks yet
+static uint32_t newEntry(stackDist *sd, uint32_t block)
+{
+  uint32_t e, level;
+
+  if (2 * (sd->entries - sd->freeCount + 1) > sd->hashSize && hashGrow(sd) != 0)
+     return STACK_NONE;
+  if (sd->freeCount > 0)
+     e = sd->freeList[--sd->freeCount];
+  else
+  {
+     if (sd->entries == sd->entrySize)
+     {
+        uint32_t size = sd->entrySize ? 2 * sd->entrySize : 1024;
+        uint32_t *r = realloc(sd->entry, (size_t) size * sd->entryWords * sizeof (uint32_t));
+        uint32_t *f = r ? realloc(sd->freeList, size * sizeof (uint32_t)) : NULL;
+        if (r)
+           sd->entry = r;
+        if (f == NULL)
+        {
+           fprintf(stderr, "cannot allocate the block entries\n");
+           return STACK_NONE;
+        }
+        sd->freeList = f;
+        sd->entrySize = size;
+     }
+     e = sd->entries++;
+  }
+  sd->entry[e * sd->entryWords] = block;
+  sd->entry[e * sd->entryWords + 1] = 0;
+  for (level = 0; level < sd->levels; level++)
+     sd->entry[e * sd->entryWords + 2 + level] = STACK_NONE;
+  hashPut(sd, block, e);
+  return e;
+}
+
+static void freeEntry(stackDist *sd, uint32_t e)
+{
+  hashRemove(sd, sd->entry[e * sd->entryWords]);
+  sd->freeList[sd->freeCount++] = e;
+}
+
+// the number of blocks of the set referenced since entry e was, or
+// STACK_NONE if e has no mark in the set
+static uint32_t distance(const stackDist *sd, const stackSet *s, uint32_t e,
+                         unsigned level)
+{
+  uint32_t slot = e == STACK_NONE ? STACK_NONE : sd->entry[e * sd->entryWords + 2 + level];
+  if (slot == STACK_NONE)
+     return STACK_NONE;
+  return s->blocks - treeCount(s, slot + 1);
+}
+
+static void unmark(stackDist *sd, stackSet *s, uint32_t e, unsigned level)
+{
+  uint32_t *slot = &sd->entry[e * sd->entryWords + 2 + level];
+  treeAdd(s, *slot, -1);
+  s->owner[*slot] = STACK_NONE;
+  *slot = STACK_NONE;
+  s->blocks--;
+  sd->entry[e * sd->entryWords + 1]--;
+}
+
+// put entry e on top of the set's stack, dropping the bottom block once the
+// set holds more than the largest number of ways
+static int promote(stackDist *sd, stackSet *s, uint32_t e, unsigned level)
+{
+  uint32_t *slot = &sd->entry[e * sd->entryWords + 2 + level];
+
+  if (*slot != STACK_NONE)
+     unmark(sd, s, e, level);
+  if (s->used == s->size && compact(sd, s, level) != 0)
+     return -1;
+  *slot = s->used++;
+  s->owner[*slot] = e;
+  treeAdd(s, *slot, 1);
+  s->blocks++;
+  sd->entry[e * sd->entryWords + 1]++;
+
+  if (s->blocks > sd->ways)
+  {
+     uint32_t oldest = s->owner[treeOldest(s)];
+     unmark(sd, s, oldest, level);
+     if (sd->entry[oldest * sd->entryWords + 1] == 0)
+        freeEntry(sd, oldest);
+  }
+  return 0;
+}
+
+static stackSet *setOf(const stackDist *sd, uint32_t block, unsigned level)
+{
+  return &sd->set[(1u << level) - 1 + (block & ((1u << level) - 1))];
+}
+
+// forget every block, as op 8 empties every cache
+static void stackReset(stackDist *sd)
+{
+  uint32_t i;
+  for (i = 0; i < 2 * sd->config.sets - 1; i++)
+  {
+     stackSet *s = &sd->set[i];
+     if (s->tree != NULL)
+        memset(s->tree, 0, (s->size + 1) * sizeof (uint32_t));
+     s->used = 0;
+     s->blocks = 0;
+  }
+  memset(sd->hashKey, 0, sd->hashSize * sizeof (uint32_t));
+  sd->entries = 0;
+  sd->freeCount = 0;
+}
+
+int stackDistCreate(stackDist *sd, const cacheConfig *cfg)
+{
+  memset(sd, 0, sizeof (stackDist));
+  sd->config = *cfg;
+
+  if (cfg->policy != REPL_LRU)
+  {
+     fprintf(stderr, "stack distances give the curve of LRU only\n");
+     return -1;
+  }
+  if (cfg->ways < 1 || cfg->ways > STACK_MAXWAYS)
+  {
+     fprintf(stderr, "ways must be 1 to %d\n", STACK_MAXWAYS);
+     return -1;
+  }
+  if ((cfg->sets & (cfg->sets - 1)) != 0)
+  {
+     fprintf(stderr, "the largest number of sets must be a power of two\n");
+     return -1;
+  }
+  if (cfg->addrBits < 1 || cfg->addrBits > 32)
+  {
+     fprintf(stderr, "address bits must be 1 to 32\n");
+     return -1;
+  }
+  sd->addrMask = cfg->addrBits == 32 ? 0xffffffffu : (1u << cfg->addrBits) - 1;
+  if ((uint64_t) cfg->sets * cfg->lineSize > (uint64_t) sd->addrMask + 1)
+  {
+     fprintf(stderr, "%u sets of %u bytes do not fit in %u address bits\n",
+             cfg->sets, cfg->lineSize, cfg->addrBits);
+     return -1;
+  }
+  makeDivider(&sd->lineDiv, cfg->lineSize);
+  sd->levels = __builtin_ctz(cfg->sets) + 1;
+  sd->entryWords = sd->levels + 2;
+  sd->ways = cfg->ways;
+
+  sd->set = calloc(2 * (size_t) cfg->sets - 1, sizeof (stackSet));
+  sd->demandHist = calloc((size_t) sd->levels * sd->ways, sizeof (long long));
+  sd->snoopHist = calloc((size_t) sd->levels * sd->ways, sizeof (long long));
+  sd->zeroMiss = calloc((size_t) sd->levels * sd->ways, sizeof (long long));
+  if (sd->set == NULL || sd->demandHist == NULL || sd->snoopHist == NULL ||
+      sd->zeroMiss == NULL || hashGrow(sd) != 0)
+  {
+     fprintf(stderr, "cannot allocate %u sets\n", cfg->sets);
+     stackDistFree(sd);
+     return -1;
+  }
+  return 0;
+}
+
+void stackDistFree(stackDist *sd)
+{
+  uint32_t i;
+  if (sd->set != NULL)
+  {
+     for (i = 0; i < 2 * sd->config.sets - 1; i++)
+        free(sd->set[i].tree);
+  }
+  free(sd->set);
+  free(sd->hashKey);
+  free(sd->hashEntry);
+  free(sd->entry);
+  free(sd->freeList);
+  free(sd->demandHist);
+  free(sd->snoopHist);
+  free(sd->zeroMiss);
+  memset(sd, 0, sizeof (stackDist));
+}
+
+// returns 0 when the block was taken in, 1 at a snooped invalidate (which
+// has not been counted) and -1, after saying why, when memory ran out
+int stackDistRun(stackDist *sd, const traceRecord *block, size_t count)
+{
+  size_t i;
+  unsigned level;
+  uint32_t b, e, d;
+  stackSet *s;
+
+  for (i = 0; i < count; i++)
+  {
+     b = divide(&sd->lineDiv, block[i].addr & sd->addrMask);
+     switch (block[i].n)
+     {
+       case 0:
+       case 2:
+       case 1:
+         if (block[i].n == 1)
+            sd->stats.writeCount++;
+         else
+            sd->stats.readCount++;
+         sd->demand++;
+         e = lookup(sd, b);
+         if (e == STACK_NONE && (e = newEntry(sd, b)) == STACK_NONE)
+            return -1;
+         for (level = 0; level < sd->levels; level++)
+         {
+            s = setOf(sd, b, level);
+            d = distance(sd, s, e, level);
+            if (d != STACK_NONE)
+               sd->demandHist[level * sd->ways + d]++;
+            if (promote(sd, s, e, level) != 0)
+               return -1;
+         }
+         break;
+       // a snooped read hits a line where it is, and changes no order
+       case 4:
+         sd->stats.readCount++;
+         e = lookup(sd, b);
+         for (level = 0; level < sd->levels; level++)
+         {
+            s = setOf(sd, b, level);
+            d = distance(sd, s, e, level);
+            if (d != STACK_NONE)
+               sd->snoopHist[level * sd->ways + d]++;
+            else if ((b >> level) == 0 && s->blocks < sd->ways)
+               sd->zeroMiss[level * sd->ways + s->blocks]++;
+         }
+         break;
+       case 3:
+       case 5:
+       case 6:
+         return 1;
+       case 8:
+         stackReset(sd);
+         break;
+     }
+     sd->stats.refCount++;
+  }
+  return 0;
+}
+
+// the counts of the cache with 1 << level sets of the given ways
+void stackDistPoint(const stackDist *sd, unsigned level, unsigned ways,
+                    cacheStats *stats)
+{
+  unsigned d;
+  long long demandHits = 0, snoopHits = 0, zeroMisses = 0;
+
+  for (d = 0; d < ways; d++)
+  {
+     demandHits += sd->demandHist[level * sd->ways + d];
+     snoopHits += sd->snoopHist[level * sd->ways + d];
+     zeroMisses += sd->zeroMiss[level * sd->ways + d];
+  }
+  *stats = sd->stats;
+  stats->hitCount = demandHits + snoopHits;
+  stats->missCount = sd->demand - demandHits + zeroMisses;
+}
@@ -0,0 +1,87 @@
+/* stackdist.h
+ *
+ * LRU hits and misses for every cache size from one pass over a trace.
+ *
+ * Under LRU a reference hits in a set of A ways exactly when fewer than A
+ * other blocks of its set were referenced since its own last reference,
+ * its stack distance (Mattson et al.). One pass recording the stack
+ * distance of every reference therefore gives the hits of every
+ * associativity at once, and keeping a stack for each power-of-two number
+ * of sets gives the whole grid.
+ *
+ * Each set keeps a Fenwick tree over the set's own time with a mark at the
+ * last reference of each block it holds; a block's stack distance is the
+ * number of marks after its own. Only the newest ways marks of a set
+ * are kept, as a block further down misses in every cache of interest.
+ *
+ * This agrees with the simulator for demand references (0, 1, 2), snooped
+ * reads (4), which do not reorder a set, resets (8) and displays (9),
+ * which are skipped. Snooped invalidates (3, 5, 6) move a line only in the
+ * caches that still hold it, so caches of different sizes stop sharing one
+ * stack; stackDistRun() refuses them and the caller has to simulate.
+ *
+ */
+
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+#include <stdint.h>
+
+#include "trace.h"
+#include "cache.h"
+
+// associativities beyond this are not worth a curve
+#define STACK_MAXWAYS 1024
+
+// one set of one set count: marks at slots 0 .. used - 1 of a Fenwick tree
+typedef struct
+{
+  uint32_t *tree;      // 1-based Fenwick tree over the slots
+  uint32_t *owner;     // the block entry marked at a slot, or STACK_NONE
+  uint32_t size;       // slots allocated
+  uint32_t used;       // slots handed out since the set was last compacted
+  uint32_t blocks;     // marks: distinct blocks since a reset, at most ways
+} stackSet;
+
+typedef struct
+{
+  cacheConfig config;  // sets and ways are the largest in the grid
+  uint32_t addrMask;
+  divider lineDiv;
+  unsigned levels;     // set counts 1, 2, 4 .. config.sets
+  unsigned ways;
+
+  // the sets of every level, level L's 1 << L sets starting at set[(1 << L) - 1]
+  stackSet *set;
+
+  // the blocks holding a mark at some level: an open addressed hash from
+  // block number to entry, and per entry, in one row of entryWords, its
+  // block, the number of levels it has a mark at (it is freed at 0) and
+  // its slot at each level
+  uint32_t *hashKey;   // block + 1, 0 for an empty bucket
+  uint32_t *hashEntry;
+  uint32_t hashSize;
+  uint32_t *entry;
+  unsigned entryWords;
+  uint32_t entries;    // entries handed out, freed ones are on freeList
+  uint32_t entrySize;
+  uint32_t *freeList;
+  uint32_t freeCount;
+
+  // per level, ways counters each
+  long long *demandHist;  // demand references at stack distance d < ways
+  long long *snoopHist;   // snooped reads hitting at distance d
+  long long *zeroMiss;    // snooped reads of tag 0, never referenced, into a
+                          // set holding d blocks: they find an untouched way,
+                          // still tagged 0, and miss in caches of more than d ways
+  long long demand;
+  cacheStats stats;       // the counts every grid point shares
+} stackDist;
+
+int stackDistCreate(stackDist *sd, const cacheConfig *cfg);
+void stackDistFree(stackDist *sd);
+int stackDistRun(stackDist *sd, const traceRecord *block, size_t count);
+void stackDistPoint(const stackDist *sd, unsigned level, unsigned ways,
+                    cacheStats *stats);
+
+#endif
@@ -0,0 +1,72 @@
+/* tagmatch.c
+ *
+ * The tag compare kernels behind tagMatch(). Each one compares all
+ * TAGLANES tags of a set and returns the matching ways as a bitmask.
+ *
+ */
+
+#include <stdint.h>
+
+#include "tagmatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+static uint32_t tagMatchScalar(const uint32_t *tags, uint32_t tag)
+{
+  uint32_t mask = 0;
+  int way;
+  for (way = 0; way < TAGLANES; way++)
+     mask |= (uint32_t) (tags[way] == tag) << way;
+  return mask;
+}
+
+#ifdef HAVE_X86
+
+// four ways per compare
+__attribute__((target("sse2")))
+static uint32_t tagMatchSSE2(const uint32_t *tags, uint32_t tag)
+{
+  __m128i t = _mm_set1_epi32(tag);
+  uint32_t mask = 0;
+  int way;
+  for (way = 0; way < TAGLANES; way += 4)
+  {
+     __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (tags + way)), t);
+     mask |= (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(eq)) << way;
+  }
+  return mask;
+}
+
+// eight ways per compare, a 16-way set is two compares
+__attribute__((target("avx2")))
+static uint32_t tagMatchAVX2(const uint32_t *tags, uint32_t tag)
+{
+  __m256i t = _mm256_set1_epi32(tag);
+  uint32_t mask = 0;
+  int way;
+  for (way = 0; way < TAGLANES; way += 8)
+  {
+     __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *) (tags + way)), t);
+     mask |= (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(eq)) << way;
+  }
+  return mask;
+}
+
+#endif
+
+uint32_t (*tagMatch)(const uint32_t *tags, uint32_t tag) = tagMatchScalar;
+
+// choose the widest kernel the host supports
+void tagMatchInit()
+{
+#ifdef HAVE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+     tagMatch = tagMatchAVX2;
+  else if (__builtin_cpu_supports("sse2"))
+     tagMatch = tagMatchSSE2;
+#endif
+}
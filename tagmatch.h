@@ -0,0 +1,22 @@
+/* tagmatch.h
+ *
+ * Compares a tag against every way of a set at once.
+ *
+ * tagMatch(tags, tag) returns a mask with bit w set when tags[w] == tag,
+ * for the TAGLANES contiguous tags of a set. tagMatchInit() picks the
+ * AVX2, SSE2 or plain C version for the host it is running on.
+ *
+ */
+
+#ifndef TAGMATCH_H
+#define TAGMATCH_H
+
+#include <stdint.h>
+
+#define TAGLANES 16
+
+extern uint32_t (*tagMatch)(const uint32_t *tags, uint32_t tag);
+
+void tagMatchInit();
+
+#endif
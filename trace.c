@@ -0,0 +1,415 @@
+/* trace.c
+ *
+ * Opens a trace file, works out whether it is text or binary, and hands
+ * the references out a block at a time.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "profile.h"
+
+// map a binary trace and point the record array at the data after the header
+// returns 0 if this is not a binary trace, 1 if it was mapped, -1 on error
+
+static int mapBinary(trace *t)
+{
+  struct stat st;
+  const traceHeader *h;
+  int fd = open(t->name, O_RDONLY);
+  if (fd < 0)
+     return -1;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof (traceHeader))
+  {
+     close(fd);
+     return 0;
+  }
+
+  t->mapSize = st.st_size;
+  t->map = mmap(NULL, t->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (t->map == MAP_FAILED)
+  {
+     t->map = NULL;
+     return -1;
+  }
+
+  h = t->map;
+  if (memcmp(h->magic, TRACE_MAGIC, 4) != 0)
+  {
+     munmap(t->map, t->mapSize);
+     t->map = NULL;
+     return 0;
+  }
+  if ((h->version != 1 && h->version != TRACE_VERSION) ||
+      h->count > (t->mapSize - sizeof (traceHeader)) / sizeof (traceRecord))
+  {
+     fprintf(stderr, "%s: unsupported or truncated binary trace\n", t->name);
+     munmap(t->map, t->mapSize);
+     t->map = NULL;
+     return -1;
+  }
+
+  // the records are read once, front to back
+  madvise(t->map, t->mapSize, MADV_SEQUENTIAL);
+  t->records = (const traceRecord *) (h + 1);
+  t->count = h->count;
+  t->next = 0;
+  t->cores = h->version >= 2;
+  return 1;
+}
+
+// hexValue[c] is the value of hex digit c, or 0xff for any other character
+// opDigit[c] is the value of decimal digit c, or 0xff
+
+static unsigned char hexValue[256];
+static unsigned char opDigit[256];
+
+// filled once, whichever thread opens the first text trace
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+static void fillTables()
+{
+  int c;
+  for (c = 0; c < 256; c++)
+  {
+     hexValue[c] = 0xff;
+     opDigit[c] = 0xff;
+  }
+  for (c = '0'; c <= '9'; c++)
+  {
+     hexValue[c] = c - '0';
+     opDigit[c] = c - '0';
+  }
+  for (c = 'a'; c <= 'f'; c++)
+  {
+     hexValue[c] = c - 'a' + 10;
+     hexValue[c - 'a' + 'A'] = c - 'a' + 10;
+  }
+}
+
+// SWAR helpers on 8 characters loaded little-endian into a uint64_t
+// between() sets the high bit of every byte b with lo < b < hi (for b < 128)
+
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+static inline uint64_t between(uint64_t x, uint64_t lo, uint64_t hi)
+{
+  uint64_t low7 = x & (ONES * 127);
+  return (ONES * (127 + hi) - low7) & ~x & (low7 + ONES * (127 - lo)) & HIGHS;
+}
+
+// decode the run of hex digits at p, store the value and return its length
+// up to 8 digits are classified and packed without a per-character branch,
+// longer runs (leading zeros) fall back to the table
+
+static inline int parseHex(const char *p, uint32_t *value)
+{
+  uint64_t x, hex, v;
+  int len;
+
+  memcpy(&x, p, 8);
+  hex = between(x, '0' - 1, '9' + 1) | between(x | (ONES * 0x20), 'a' - 1, 'g');
+  len = (~hex & HIGHS) ? __builtin_ctzll(~hex & HIGHS) >> 3 : 8;
+  if (len == 0)
+     return 0;
+
+  // each byte becomes its nibble, first character most significant
+  v = (x & (ONES * 0x0f)) + 9 * ((x >> 6) & ONES);
+  v = ((v & 0x000f000f000f000fULL) << 4) | ((v & 0x0f000f000f000f00ULL) >> 8);
+  v = ((v & 0x000000ff000000ffULL) << 8) | ((v & 0x00ff000000ff0000ULL) >> 16);
+  v = ((v & 0x000000000000ffffULL) << 16) | ((v & 0x0000ffff00000000ULL) >> 32);
+  *value = (uint32_t) (v >> (4 * (8 - len)));
+
+  if (len == 8)
+  {
+     // keep only the low 32 bits, as %x does
+     while (hexValue[(unsigned char) p[len]] != 0xff)
+        *value = (*value << 4) | hexValue[(unsigned char) p[len++]];
+  }
+  return len;
+}
+
+// move the unparsed tail of the text to the front and read the next chunk
+// the text is always followed by zeros so parseHex can look 8 bytes ahead
+
+static void refill(trace *t)
+{
+  size_t left = t->textLen - t->textPos;
+  ssize_t got;
+
+  memmove(t->text, t->text + t->textPos, left);
+  t->textPos = 0;
+  t->textLen = left;
+  while (!t->eof && t->textLen < TRACE_CHUNK)
+  {
+     got = read(t->fd, t->text + t->textLen, TRACE_CHUNK - t->textLen);
+     if (got <= 0)
+        t->eof = 1;
+     else
+        t->textLen += got;
+  }
+  memset(t->text + t->textLen, 0, 16);
+}
+
+// report a line that is not of the form 'n address' and stop the trace
+
+static void malformed(trace *t)
+{
+  fprintf(stderr, "%s:%lu: malformed trace line, expected 'n address [core]'\n",
+          t->name, t->line);
+  t->error = 1;
+}
+
+// parse lines from the text buffer into buf until max have been read or the
+// text ends
+
+static size_t parseText(trace *t, size_t max)
+{
+  size_t count = 0;
+  const char *p, *end;
+  unsigned op, core;
+  uint32_t addr;
+  int len;
+
+  while (count < max && !t->error)
+  {
+     if (!t->eof && t->textLen - t->textPos < TRACE_LINEMAX)
+        refill(t);
+     p = t->text + t->textPos;
+     end = t->text + t->textLen;
+
+     // skip blank space and empty lines up to the next reference
+     while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+     {
+        if (*p == '\n')
+           t->line++;
+        p++;
+     }
+     t->textPos = p - t->text;
+     if (p == end)
+     {
+        if (t->eof)
+           break;
+        continue;
+     }
+
+     // the op is nearly always a single digit
+     op = opDigit[(unsigned char) *p];
+     if (op == 0xff)
+     {
+        malformed(t);
+        break;
+     }
+     p++;
+     while (opDigit[(unsigned char) *p] != 0xff)
+     {
+        op = op * 10 + opDigit[(unsigned char) *p++];
+        if (op > 9)
+           op = 0xff;
+     }
+
+     if (*p != ' ' && *p != '\t')
+     {
+        malformed(t);
+        break;
+     }
+     while (*p == ' ' || *p == '\t')
+        p++;
+
+     if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && hexValue[(unsigned char) p[2]] != 0xff)
+        p += 2;
+     len = parseHex(p, &addr);
+     if (len == 0)
+     {
+        malformed(t);
+        break;
+     }
+     p += len;
+
+     while (*p == ' ' || *p == '\t' || *p == '\r')
+        p++;
+
+     // an optional decimal core id, 0 to 255
+     core = 0;
+     if (opDigit[(unsigned char) *p] != 0xff)
+     {
+        while (opDigit[(unsigned char) *p] != 0xff && core <= 255)
+           core = core * 10 + opDigit[(unsigned char) *p++];
+        while (*p == ' ' || *p == '\t' || *p == '\r')
+           p++;
+     }
+     if ((p < end && *p != '\n') || core > 255)
+     {
+        malformed(t);
+        break;
+     }
+
+     // ops outside 0-9 are counted but do nothing, keep them out of range
+     t->buf[count] = (traceRecord) { .addr = addr, .n = op, .core = core };
+     count++;
+     t->textPos = p - t->text;
+  }
+  return count;
+}
+
+int traceOpen(trace *t, const char *name)
+{
+  memset(t, 0, sizeof (trace));
+  t->name = name;
+  t->fd = -1;
+  t->left = UINT64_MAX;
+
+  switch (mapBinary(t))
+  {
+    case 1:
+      return 0;
+    case -1:
+      return -1;
+  }
+
+  // not binary, read it as text lines
+  pthread_once(&tablesOnce, fillTables);
+  t->fd = open(name, O_RDONLY);
+  if (t->fd < 0)
+     return -1;
+  posix_fadvise(t->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  t->text = malloc(TRACE_CHUNK + 16);
+  t->buf = malloc(TRACE_BLOCK * sizeof (traceRecord));
+  if (t->text == NULL || t->buf == NULL)
+  {
+     traceClose(t);
+     return -1;
+  }
+  t->line = 1;
+  t->cores = 1;
+  memset(t->text, 0, 16);
+  return 0;
+}
+
+// point *block at the next run of references and return how many there are
+// returns 0 at the end of the trace, or after a malformed line (t->error)
+
+static size_t nextBlock(trace *t, const traceRecord **block)
+{
+  size_t count = t->left < TRACE_BLOCK ? t->left : TRACE_BLOCK;
+
+  if (t->map != NULL)
+  {
+     if (count > t->count - t->next)
+        count = t->count - t->next;
+     *block = t->records + t->next;
+     t->next += count;
+  }
+  else
+  {
+     *block = t->buf;
+     count = parseText(t, count);
+  }
+  t->left -= count;
+  return count;
+}
+
+// the same, timed as decoding in a profile build, see profile.h
+size_t traceNext(trace *t, const traceRecord **block)
+{
+#ifdef PROFILE
+  uint64_t start = profileNow();
+  size_t count = nextBlock(t, block);
+  profileDecoded(profileNow() - start, count);
+  return count;
+#else
+  return nextBlock(t, block);
+#endif
+}
+
+// pass over the next n references; returns how many there were
+// binary traces just move on, text traces still have to be parsed
+
+uint64_t traceSkip(trace *t, uint64_t n)
+{
+  uint64_t skipped = 0;
+  size_t count;
+
+  if (t->map != NULL)
+  {
+     skipped = n < t->count - t->next ? n : t->count - t->next;
+     t->next += skipped;
+     return skipped;
+  }
+  while (skipped < n)
+  {
+     count = parseText(t, n - skipped < TRACE_BLOCK ? n - skipped : TRACE_BLOCK);
+     if (count == 0)
+        break;
+     skipped += count;
+  }
+  return skipped;
+}
+
+// hand out at most n more references
+
+void traceLimit(trace *t, uint64_t n)
+{
+  t->left = n;
+}
+
+void traceClose(trace *t)
+{
+  if (t->map != NULL)
+     munmap(t->map, t->mapSize);
+  if (t->fd >= 0)
+     close(t->fd);
+  free(t->text);
+  free(t->buf);
+  memset(t, 0, sizeof (trace));
+  t->fd = -1;
+}
+
+// read a count of references such as 1000000, 1000K, 1M or 1G, the
+// suffixes being powers of two
+// returns -1 if it is not one, or does not fit
+
+int parseSize(const char *value, uint64_t *size)
+{
+  char *end;
+  unsigned long long n;
+  int shift = 0;
+
+  if (value[0] == '-')
+     return -1;
+  n = strtoull(value, &end, 0);
+  if (end == value)
+     return -1;
+  switch (*end)
+  {
+    case 'k':
+    case 'K':
+      shift = 10;
+      end++;
+      break;
+    case 'm':
+    case 'M':
+      shift = 20;
+      end++;
+      break;
+    case 'g':
+    case 'G':
+      shift = 30;
+      end++;
+      break;
+  }
+  if (*end != '\0' || n > UINT64_MAX >> shift)
+     return -1;
+  *size = (uint64_t) n << shift;
+  return 0;
+}
@@ -0,0 +1,90 @@
+/* trace.h
+ *
+ * Reading the 'n address' trace that drives the simulator.
+ *
+ * A trace is either the text form (see testfile.din), one reference per
+ * line with an optional third field giving the core that made it, or the
+ * packed binary form written by din2bin. Binary traces are mapped
+ * straight into memory and the records are handed to main() without
+ * being copied or parsed.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// binary trace layout: one traceHeader followed by 'count' traceRecords,
+// all little-endian as written by the host running din2bin
+
+#define TRACE_MAGIC "L2TR"
+// version 1 records have no core id, their pad bytes are not even zeroed
+#define TRACE_VERSION 2
+
+// number of references handed out by each call to traceNext()
+#define TRACE_BLOCK 65536
+
+// text traces are read in chunks of TRACE_CHUNK bytes, and a line may be
+// at most TRACE_LINEMAX bytes long
+#define TRACE_CHUNK (1 << 20)
+#define TRACE_LINEMAX 4096
+
+typedef struct
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t count;
+} traceHeader;
+
+// one reference: the 32-bit address, the operation 'n' and the core that
+// made it (0 in a trace that does not say)
+// the record is padded to 8 bytes so the mapped array stays aligned
+typedef struct
+{
+  uint32_t addr;
+  uint8_t n;
+  uint8_t core;
+  uint8_t pad[2];
+} traceRecord;
+
+typedef struct
+{
+  const char *name;
+
+  // text traces are read into text a chunk at a time and parsed into buf
+  int fd;
+  char *text;
+  size_t textPos;
+  size_t textLen;
+  int eof;
+  unsigned long line;
+  traceRecord *buf;
+
+  // set when a malformed line stopped the trace
+  int error;
+
+  // the records' core ids are meaningful, true of every text trace but
+  // not of a version 1 binary one
+  int cores;
+
+  // references still to be handed out, see traceLimit()
+  uint64_t left;
+
+  // binary traces are mapped and walked in place
+  void *map;
+  size_t mapSize;
+  const traceRecord *records;
+  uint64_t count;
+  uint64_t next;
+} trace;
+
+int traceOpen(trace *t, const char *name);
+size_t traceNext(trace *t, const traceRecord **block);
+uint64_t traceSkip(trace *t, uint64_t n);
+void traceLimit(trace *t, uint64_t n);
+void traceClose(trace *t);
+int parseSize(const char *value, uint64_t *size);
+
+#endif
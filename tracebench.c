@@ -0,0 +1,117 @@
+/* tracebench.c
+ *
+ * Measures how fast a text trace can be read, comparing the fscanf loop
+ * main used to have against the block tokenizer in trace.c.
+ *
+ * usage: tracebench [trace.din]
+ *
+ * Without a trace, a 10M line trace of 'n address' lines is written to
+ * /tmp first and removed afterwards.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "trace.h"
+
+#define GENLINES 10000000
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// write a trace in the same shape as testfile.din
+
+static int generate(char *name)
+{
+  int fd = mkstemp(name);
+  FILE *fp;
+  uint32_t x = 12345;
+  long i;
+
+  if (fd < 0 || (fp = fdopen(fd, "w")) == NULL)
+     return -1;
+  for (i = 0; i < GENLINES; i++)
+  {
+     x ^= x << 13;
+     x ^= x >> 17;
+     x ^= x << 5;
+     fprintf(fp, "%d %08x\n", x % 3, x);
+  }
+  return fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+  char tmpname[] = "/tmp/tracebenchXXXXXX";
+  const char *name = tmpname;
+  const traceRecord *block;
+  trace t;
+  FILE *ifp;
+  size_t count, i;
+  long refs;
+  double start, slow, fast;
+  int n;
+  unsigned int addr;
+  uint32_t sum;
+
+  if (argc > 1)
+     name = argv[1];
+  else if (generate(tmpname) != 0)
+  {
+     fprintf(stderr, "cannot write %s\n", tmpname);
+     return 1;
+  }
+
+  // the old loop in main()
+  ifp = fopen(name, "r");
+  if (ifp == NULL)
+  {
+     fprintf(stderr, "%s: cannot read trace\n", name);
+     return 1;
+  }
+  refs = 0;
+  sum = 0;
+  start = now();
+  while (fscanf(ifp, "%d %x\n", &n, &addr) == 2)
+  {
+     sum += n + addr;
+     refs++;
+  }
+  slow = now() - start;
+  fclose(ifp);
+  printf("fscanf:    %ld references in %.3f s, %.1f M refs/s (checksum %08x)\n",
+         refs, slow, refs / slow / 1e6, sum);
+
+  // the block tokenizer
+  if (traceOpen(&t, name) != 0)
+  {
+     fprintf(stderr, "%s: cannot read trace\n", name);
+     return 1;
+  }
+  refs = 0;
+  sum = 0;
+  start = now();
+  while ((count = traceNext(&t, &block)) > 0)
+  {
+     for (i = 0; i < count; i++)
+        sum += block[i].n + block[i].addr;
+     refs += count;
+  }
+  fast = now() - start;
+  traceClose(&t);
+  printf("tokenizer: %ld references in %.3f s, %.1f M refs/s (checksum %08x)\n",
+         refs, fast, refs / fast / 1e6, sum);
+  printf("speedup:   %.1fx\n", slow / fast);
+
+  if (argc <= 1)
+     unlink(tmpname);
+  return 0;
+}
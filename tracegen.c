@@ -0,0 +1,253 @@
+/* tracegen.c
+ *
+ * Writes synthetic binary traces (see trace.h) for benchmarking. The same
+ * kind, count and seed always give the same trace.
+ *
+ *   seq     reads and some writes walking 16 bytes at a time through
+ *           256 MB, over and over
+ *   stride  eight walks at once with strides of 8 bytes to 8 KB
+ *   random  reads, writes and fetches spread evenly over 4 GB
+ *   zipf    references to 1M lines of which a few are hot, the k-th most
+ *           popular referenced in proportion to 1 / k^0.99, scattered so
+ *           the hot lines fall in different sets
+ *   share   four cores on a producer/consumer ring: core 0 writes lines
+ *           the others then read, each core also reads private data, and
+ *           some other agent snoops the ring with ops 3 to 6
+ *   check   every op from 0 to 9 for 'make test': most references go back
+ *           to one of the last 64 lines, the rest to any of 4096 sets'
+ *           worth of lines with 32 tags each, a reset comes once in
+ *           about 128K references and a display once in about 256K
+ *
+ * usage: tracegen kind count output.bin [seed]
+ *
+ * count may have a K, M or G suffix (2^10, 2^20 or 2^30).
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define ZIPF_LINES (1 << 20)
+#define ZIPF_S 0.99
+#define ZIPF_GUIDE 65536
+
+#define RING_LINES 4096
+#define CORES 4
+
+#define RECENT 64
+
+static uint64_t state;
+
+static uint64_t next64(void)
+{
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+// a number below n
+static uint32_t below(uint32_t n)
+{
+  return (uint32_t) (((next64() >> 32) * n) >> 32);
+}
+
+// the cumulative distribution of the zipf lines' popularity, and for each
+// of ZIPF_GUIDE equal steps of it the first line reaching the step, so a
+// draw only searches the lines between two guides
+static double *cdf;
+static uint32_t guide[ZIPF_GUIDE + 1];
+
+static int zipfTable(void)
+{
+  double sum = 0;
+  uint32_t k, g = 0;
+
+  cdf = malloc(ZIPF_LINES * sizeof (double));
+  if (cdf == NULL)
+     return -1;
+  for (k = 0; k < ZIPF_LINES; k++)
+  {
+     sum += 1 / pow(k + 1, ZIPF_S);
+     cdf[k] = sum;
+  }
+  for (k = 0; k < ZIPF_LINES; k++)
+  {
+     cdf[k] /= sum;
+     while (g <= ZIPF_GUIDE && cdf[k] >= (double) g / ZIPF_GUIDE)
+        guide[g++] = k;
+  }
+  while (g <= ZIPF_GUIDE)
+     guide[g++] = ZIPF_LINES - 1;
+  return 0;
+}
+
+static uint32_t zipfLine(void)
+{
+  double u = (next64() >> 11) * (1.0 / 9007199254740992.0);
+  uint32_t g = (uint32_t) (u * ZIPF_GUIDE);
+  uint32_t lo = g ? guide[g] : 0, hi = guide[g + 1], mid;
+
+  while (lo < hi)
+  {
+     mid = (lo + hi) / 2;
+     if (cdf[mid] < u)
+        lo = mid + 1;
+     else
+        hi = mid;
+  }
+  // a bijection of the line numbers, so popular lines are not neighbours
+  return (lo * 2654435761u) & (ZIPF_LINES - 1);
+}
+
+// the i-th reference of a trace of the given kind
+static traceRecord generate(int kind, uint64_t i)
+{
+  static const uint32_t strides[8] = { 8, 32, 64, 192, 256, 1024, 4096, 8192 };
+  static uint32_t ringHead;
+  static uint32_t recent[RECENT];
+  traceRecord r;
+  uint32_t x = below(100);
+
+  memset(&r, 0, sizeof (r));
+  switch (kind)
+  {
+    case 0:
+      r.addr = 0x10000000 + (uint32_t) ((i * 16) & 0x0fffffff);
+      r.n = x < 75 ? 0 : 1;
+      break;
+    case 1:
+      r.addr = 0x20000000 + (i % 8) * 0x01000000
+               + (uint32_t) ((i / 8 * strides[i % 8]) & 0x00ffffff);
+      r.n = x < 80 ? 0 : 1;
+      break;
+    case 2:
+      r.addr = (uint32_t) next64();
+      r.n = x < 50 ? 0 : x < 70 ? 1 : 2;
+      break;
+    case 3:
+      r.addr = 0x40000000 + zipfLine() * 64 + below(16) * 4;
+      r.n = x < 60 ? 0 : x < 80 ? 1 : 2;
+      break;
+    case 4:
+      if (x < 20)
+      {
+         // the producer fills the next line of the ring
+         r.addr = 0x50000000 + (ringHead++ % RING_LINES) * 64;
+         r.n = 1;
+         r.core = 0;
+      }
+      else if (x < 50)
+      {
+         // a consumer reads a line the producer wrote a little while ago
+         r.core = 1 + below(CORES - 1);
+         r.addr = 0x50000000 + ((ringHead - r.core * 64) % RING_LINES) * 64;
+         r.n = 0;
+      }
+      else if (x < 85)
+      {
+         // private data and code of any core
+         r.core = below(CORES);
+         r.addr = 0x60000000 + r.core * 0x00400000 + below(0x00400000);
+         r.n = x < 70 ? 0 : 2;
+      }
+      else
+      {
+         // another agent on the bus
+         r.addr = 0x50000000 + below(RING_LINES) * 64;
+         r.n = 3 + below(4);
+      }
+      break;
+    case 5:
+      x = below(1 << 18);
+      if (x < 1)
+         r.n = 9;
+      else if (x < 3)
+         r.n = 8;
+      else
+      {
+         x = below(100);
+         r.n = x < 40 ? 0 : x < 62 ? 1 : x < 72 ? 2 : x < 77 ? 3 : x < 85 ? 4 :
+               x < 90 ? 5 : x < 95 ? 6 : 7;
+      }
+      if (below(100) < 70)
+         r.addr = recent[below(RECENT)] | below(64);
+      else
+      {
+         r.addr = below(32) << 22 | below(4096) << 6 | below(64);
+         recent[i % RECENT] = r.addr & ~63u;
+      }
+      break;
+  }
+  return r;
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *kinds[] = { "seq", "stride", "random", "zipf", "share", "check" };
+  static traceRecord out[TRACE_BLOCK];
+  traceHeader h;
+  char tmp[4096];
+  uint64_t count, i;
+  size_t n, j;
+  int kind;
+  FILE *ofp;
+
+  if (argc != 4 && argc != 5)
+  {
+     fprintf(stderr, "usage: %s seq|stride|random|zipf|share|check count output.bin [seed]\n",
+             argv[0]);
+     return 1;
+  }
+  for (kind = 0; kind < 6 && strcmp(argv[1], kinds[kind]) != 0; kind++)
+     ;
+  if (kind == 6 || parseSize(argv[2], &count) != 0)
+  {
+     fprintf(stderr, "usage: %s seq|stride|random|zipf|share|check count output.bin [seed]\n",
+             argv[0]);
+     return 1;
+  }
+  state = argc == 5 ? strtoull(argv[4], NULL, 0) : 88172645463325252ull;
+  if (state == 0)
+     state = 1;
+  if (kind == 3 && zipfTable() != 0)
+  {
+     fprintf(stderr, "cannot allocate the zipf table\n");
+     return 1;
+  }
+
+  // written under another name and renamed when complete, so that a
+  // failed run never leaves a trace that looks whole
+  if (snprintf(tmp, sizeof (tmp), "%s.tmp", argv[3]) >= (int) sizeof (tmp) ||
+      (ofp = fopen(tmp, "wb")) == NULL)
+  {
+     fprintf(stderr, "%s: cannot create\n", argv[3]);
+     return 1;
+  }
+  memset(&h, 0, sizeof (h));
+  memcpy(h.magic, TRACE_MAGIC, 4);
+  h.version = TRACE_VERSION;
+  h.count = count;
+  fwrite(&h, sizeof (h), 1, ofp);
+  for (i = 0; i < count; i += n)
+  {
+     n = count - i < TRACE_BLOCK ? count - i : TRACE_BLOCK;
+     for (j = 0; j < n; j++)
+        out[j] = generate(kind, i + j);
+     if (fwrite(out, sizeof (traceRecord), n, ofp) != n)
+        break;
+  }
+  if (fclose(ofp) != 0 || i < count || rename(tmp, argv[3]) != 0)
+  {
+     fprintf(stderr, "%s: write failed\n", argv[3]);
+     unlink(tmp);
+     return 1;
+  }
+  free(cdf);
+  return 0;
+}